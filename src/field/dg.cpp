@@ -13,7 +13,8 @@ namespace DG {
     Scalar **dpsi[3];
     Scalar *xgl[3];
     Scalar *wgl[3];
-    TensorCellField Jinv(false);
+    std::vector<Tensor> Jinv;
+    IntVector Jstart;
 }
 /** 
 Compute legendre polynomial and its first & second derivatives, given p and x
@@ -452,9 +453,10 @@ void DG::init_basis() {
     //init geometry
     init_geom();
     
-    //Compute Jacobian matrix
-    Jinv.deallocate(false);
-    Jinv.construct();
+    //Compute Jacobian matrix. Affine elements keep only one.
+    std::vector<Tensor> Je(NP);
+    Jinv.clear();
+    Jstart.assign(gBCS + 1,0);
     for(Int ci = 0; ci < gBCS;ci++) {
         forEachLgl(ii,jj,kk) {
             Tensor Ji(Scalar(0));
@@ -479,9 +481,20 @@ void DG::init_basis() {
             if(NPY == 1) Ji[YY] = 0;
             if(NPZ == 1) Ji[ZZ] = 0;
             
-            Int index = INDEX4(ci,ii,jj,kk);
-            Jinv[index] = Ji;
+            Je[INDEX3(ii,jj,kk)] = Ji;
         }
+        
+        bool affine = true;
+        Scalar tol = 1e-8 * mag(Je[0]);
+        for(Int n = 1;n < NP && affine;n++) {
+            if(mag(Je[n] - Je[0]) > tol)
+                affine = false;
+        }
+        if(affine)
+            Jinv.push_back(Je[0]);
+        else
+            Jinv.insert(Jinv.end(),Je.begin(),Je.end());
+        Jstart[ci + 1] = Jinv.size();
     }
 }
 
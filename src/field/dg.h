@@ -71,13 +71,20 @@
 
 #define DPSI(dij,i,j,k)  DPSI_(dij,i,j,k,ii,jj,kk)
 #define DPSIR(dij,i,j,k) DPSI_(dij,ii,jj,kk,i,j,k)
+
+#define JACOBIAN(c_)                                                    \
+    const Tensor* Je = &Jinv[Jstart[c_]];                               \
+    const Int Js = (Jstart[(c_) + 1] - Jstart[c_] == 1) ? 0 : 1
+
+#define JINV(i_,j_,k_) Je[Js * INDEX3(i_,j_,k_)]
             
 namespace DG {
     extern Scalar **psi[3];
     extern Scalar **dpsi[3];
     extern Scalar *xgl[3];
     extern Scalar *wgl[3];
-    extern TensorCellField Jinv;
+    extern std::vector<Tensor> Jinv;
+    extern IntVector Jstart;
     extern Int NPX, NPY, NPZ;
     extern Scalar Penalty;
     
@@ -15,9 +15,10 @@ namespace Mesh {
     ScalarCellField   cV(false);
     ScalarFacetField  fI(false);
     ScalarFacetField  fD(false);
-    ScalarCellField   yWall(false);
+    FloatField<Scalar,CELL> yWall;
     IntVector         FO;
     IntVector         FN;
+    bool              reuseMesh = false;
     IntVector  probeCells;
     Int         gBCSfield;
     Int         gBCSIfield;
@@ -48,12 +49,18 @@ namespace Controls {
     TimeScheme time_scheme = BDF1;
     Scalar implicit_factor = 1;
     Int runge_kutta = 1;
+    Int matrix_free = 0;
+    Scalar CFL = 0;
+    Int lts_levels = 1;
+    Int imex = 0;
     Scalar blend_factor = Scalar(0.2);
     Scalar tolerance = Scalar(1e-5f);
     Scalar dt = Scalar(.1);
     Scalar SOR_omega = Scalar(1.7);
     Solvers Solver = PCG; 
     Preconditioners Preconditioner = SSOR;
+    MgCycle mg_cycle = V_CYCLE;
+    Int mg_sweeps = 2;
     State state = STEADY;
     Int max_iterations = 500;
     Int write_interval = 20;
@@ -63,6 +70,8 @@ namespace Controls {
     Int n_deferred = 0;
     Int save_average = 0;
     Int print_time = 0;
+    Scalar steady_tolerance = 0;
+    Int steady_steps = 5;
     CommMethod parallel_method = BLOCKED;
     Vector gravity = Vector(0,0,-9.860616);
 }
@@ -89,6 +98,24 @@ bool Mesh::LoadMesh(Int step_, bool first, bool remove_empty) {
     /*load refined mesh*/
     int step = findLastRefinedGrid(step_);
     
+    /*reuse the mesh if it is loaded from the same file already*/
+    static string loaded;
+    stringstream key;
+    if(gMeshName[0] != '/') {
+        char cwd[PATH_MAX + 1];
+        System::pwd(cwd,PATH_MAX + 1);
+        key << cwd << "/";
+    }
+    key << gMeshName << "_" << step << "_" << remove_empty;
+    if(reuseMesh && loaded == key.str()) {
+        Mesh::clearBC();
+        Mesh::probePoints.clear();
+        remove_fields();
+        initGeomMeshFields();
+        return true;
+    }
+    loaded.clear();
+    
     /*load mesh*/
     if(gMesh.readMesh(step,first)) {
         /*clear bc and probing points list*/
@@ -127,6 +154,7 @@ bool Mesh::LoadMesh(Int step_, bool first, bool remove_empty) {
         initGeomMeshFields();
         if(MP::printOn) 
             cout << "--------------------------------------------\n";
+        loaded = key.str();
         return true;
     }
     return false;
@@ -232,14 +260,14 @@ void Mesh::initGeomMeshFields() {
         VectorCellField grad_psi = Vector(0);
 
         for(Int ci = 0; ci < gBCS; ci++) {
+            JACOBIAN(ci);
             forEachLglBound(ii,jj,kk) {
                 Int index = INDEX4(ci,ii,jj,kk);
                 
 #define PSID(im,jm,km) {                    \
-    Int index1 = INDEX4(ci,im,jm,km);       \
     Vector dpsi_ij;                         \
     DPSIR(dpsi_ij,im,jm,km);                \
-    dpsi_ij = dot(Jinv[index1],dpsi_ij);    \
+    dpsi_ij = dot(JINV(im,jm,km),dpsi_ij);  \
     grad_psi[index] += dpsi_ij;             \
 }
                 forEachLglX(i) PSID(i,jj,kk);
@@ -267,14 +295,13 @@ void Mesh::initGeomMeshFields() {
     }
     /*Construct wall distance field*/
     {
-        yWall.deallocate(false);
-        yWall.construct();
-        yWall = Scalar(0);
+        ScalarCellField y;
+        y = Scalar(0);
         //boundary
         BCondition<Scalar>* bc;
         forEachIt(Boundaries,gBoundaries,it) {
             string bname = it->first;
-            bc = new BCondition<Scalar>(yWall.fName);
+            bc = new BCondition<Scalar>(y.fName);
             bc->bname = bname;
             if(bname.find("WALL") != std::string::npos) {
                 bc->cname = "DIRICHLET";
@@ -287,7 +314,8 @@ void Mesh::initGeomMeshFields() {
             bc->init_indices();
             AllBConditions.push_back(bc);
         }
-        applyExplicitBCs(yWall,true,true);
+        applyExplicitBCs(y,true,true);
+        yWall = y;
     }
 }
 /**
@@ -439,10 +467,20 @@ void Mesh::enroll(Util::ParamList& params) {
     op = new Option(&time_scheme,6,"BDF1","BDF2","BDF3","BDF4","BDF5","BDF6");
     params.enroll("time_scheme",op);
     params.enroll("runge_kutta",&runge_kutta);
+    op = new BoolOption(&matrix_free);
+    params.enroll("matrix_free",op);
+    params.enroll("CFL",&CFL);
+    params.enroll("lts_levels",&lts_levels);
+    op = new BoolOption(&imex);
+    params.enroll("imex",op);
     op = new Option(&Solver,3,"JAC","SOR","PCG");
     params.enroll("method",op);
-    op = new Option(&Preconditioner,4,"NONE","DIAG","SSOR","DILU");
+    op = new Option(&Preconditioner,7,"NONE","DIAG","SSOR","DILU","GMG",
+        "BJAC","BILU");
     params.enroll("preconditioner",op);
+    op = new Option(&mg_cycle,2,"V","W");
+    params.enroll("mg_cycle",op);
+    params.enroll("mg_sweeps",&mg_sweeps);
     op = new Option(&state,2,"STEADY","TRANSIENT");
     params.enroll("state",op);
     op = new Option(&parallel_method,2,"BLOCKED","ASYNCHRONOUS");
@@ -450,6 +488,8 @@ void Mesh::enroll(Util::ParamList& params) {
     op = new Util::BoolOption(&save_average);
     params.enroll("average",op);
     params.enroll("print_time",&print_time);
+    params.enroll("steady_tolerance",&steady_tolerance);
+    params.enroll("steady_steps",&steady_steps);
     params.enroll("npx",&DG::Nop[0]);
     params.enroll("npy",&DG::Nop[1]);
     params.enroll("npz",&DG::Nop[2]);
@@ -741,13 +781,30 @@ void decomposeMetis(int total,IntVector& blockIndex) {
     }
     xadj.push_back(adjncy.size());
 
+    /*weigh cells by the number of multirate substeps of their size level*/
+    std::vector<int> vwgt;
+    if(Controls::lts_levels > 1) {
+        Int nlevel = Controls::lts_levels - 1;
+        Scalar hmin = Scalar(1e30);
+        for(Int i = 0;i < gBCS;i++)
+            hmin = min(hmin,pow(gCV[i],Scalar(1) / 3));
+        vwgt.resize(gBCS);
+        for(Int i = 0;i < gBCS;i++) {
+            Scalar h = pow(gCV[i],Scalar(1) / 3);
+            Int l = 0;
+            while(l < nlevel && h >= hmin * (1 << (l + 1)))
+                l++;
+            vwgt[i] = 1 << (nlevel - l);
+        }
+    }
+
     /*partition*/
     METIS_PartGraphRecursive (
         &ncells,
         &ncon,
         &xadj[0],
         &adjncy[0],
-        NULL,
+        vwgt.size() ? &vwgt[0] : NULL,
         NULL,
         NULL,
         &total,
@@ -1007,9 +1064,10 @@ int Prepare::decomposeMesh(Int step) {
     return 0;
 }
 /**
-Reverse decomposition
+Reverse decomposition of fields at step. The mesh and indices are those
+decomposed at stepm, by default the last refined grid.
 */
-int Prepare::mergeFields(Int step) {
+int Prepare::mergeFields(Int step,int stepm) {
     using namespace Mesh;
     using namespace Controls;
     
@@ -1022,7 +1080,8 @@ int Prepare::mergeFields(Int step) {
     std::cout << "Merging fields at step " << step << std::endl;
 
     /*Read mesh*/
-    int stepm = findLastRefinedGrid(step);
+    if(stepm < 0)
+        stepm = findLastRefinedGrid(step);
     LoadMesh(stepm,true,false);
 
     /*Read fields*/
@@ -1065,3 +1124,302 @@ int Prepare::mergeFields(Int step) {
     return 0;
 }
 
+/*********************************
+ *
+ * Mapping fields between meshes
+ *
+ *********************************/
+namespace Prepare {
+
+/**
+Uniform grid of bins over a set of points
+*/
+struct PointBins {
+    Vector bMin;           /**< Lower corner of the grid */
+    Scalar h;              /**< Bin size */
+    Int nb[3];             /**< Number of bins in each direction */
+    IntVector start;       /**< Start of each bin in index */
+    IntVector index;       /**< Points sorted by bin */
+
+    PointBins(const VectorVector&);
+    Int bin(const Vector& v,Int j) const {
+        return min(nb[j] - 1,Int(max(Scalar(0),(v[j] - bMin[j]) / h)));
+    }
+    Int id(Int x,Int y,Int z) const {
+        return x + nb[0] * (y + nb[1] * z);
+    }
+    Int nearest(const VectorVector&,const Vector&) const;
+};
+
+PointBins::PointBins(const VectorVector& p) {
+    Int n = p.size();
+    bMin = p[0];
+    Vector bMax = p[0];
+    for(Int i = 0;i < n;i++) {
+        bMin = min(bMin,p[i]);
+        bMax = max(bMax,p[i]);
+    }
+    Vector bL = bMax - bMin;
+    h = max(bL[0],max(bL[1],bL[2]));
+    {
+        Scalar vol = 1;
+        Int nd = 0;
+        for(Int j = 0;j < 3;j++) {
+            if(bL[j] > h * 1e-6) {
+                vol *= bL[j];
+                nd++;
+            }
+        }
+        if(nd) h = pow(vol / n,1.0 / nd);
+        if(h <= 0) h = 1;
+    }
+    for(Int j = 0;j < 3;j++)
+        nb[j] = Int(bL[j] / h) + 1;
+    start.assign(nb[0] * nb[1] * nb[2] + 1,0);
+    index.resize(n);
+    for(Int i = 0;i < n;i++)
+        start[id(bin(p[i],0),bin(p[i],1),bin(p[i],2)) + 1]++;
+    for(Int b = 1;b < start.size();b++)
+        start[b] += start[b - 1];
+    IntVector pos(start.begin(),start.end() - 1);
+    for(Int i = 0;i < n;i++)
+        index[pos[id(bin(p[i],0),bin(p[i],1),bin(p[i],2))]++] = i;
+}
+
+/**
+Nearest point by searching shells of bins
+*/
+Int PointBins::nearest(const VectorVector& p,const Vector& v) const {
+    int c[3];
+    for(Int j = 0;j < 3;j++)
+        c[j] = bin(v,j);
+    Int best = 0;
+    Scalar bestd = -1;
+    int maxr = max(nb[0],max(nb[1],nb[2]));
+    for(int r = 0;r <= maxr;r++) {
+        if(bestd >= 0 && bestd < pow((r - 1) * h,2)) 
+            break;
+        for(int z = c[2] - r;z <= c[2] + r;z++) {
+        for(int y = c[1] - r;y <= c[1] + r;y++) {
+        for(int x = c[0] - r;x <= c[0] + r;x++) {
+            if(x < 0 || y < 0 || z < 0 || x >= int(nb[0]) ||
+               y >= int(nb[1]) || z >= int(nb[2]))
+                continue;
+            if(abs(x - c[0]) != r && abs(y - c[1]) != r && 
+               abs(z - c[2]) != r)
+                continue;
+            Int b = id(x,y,z);
+            for(Int k = start[b];k < start[b + 1];k++) {
+                Scalar d = magSq(p[index[k]] - v);
+                if(bestd < 0 || d < bestd) {
+                    bestd = d;
+                    best = index[k];
+                }
+            }
+        }
+        }
+        }
+    }
+    return best;
+}
+
+/**
+Write volume weighted averages of source cell fields 
+*/
+template<class T>
+void mapCellFields(map<string,string>& mapped,IntVector& start,
+                   IntVector& index,ScalarVector& weight) {
+    typedef MeshField<T,CELL> CellField;
+    Int size = start.size() - 1;
+    forEachIt(typename std::list<CellField*>, CellField::fields_, it) {
+        CellField& src = *(*it);
+        if(!(src.access & WRITE))
+            continue;
+        stringstream os;
+        os.precision(12);
+        os << "size " << sizeof(T) / sizeof(Scalar) << endl;
+        os << size << endl;
+        os << "{" << endl;
+        for(Int i = 0;i < size;i++) {
+            T sum = T(0);
+            Scalar sumw = 0;
+            for(Int j = start[i];j < start[i + 1];j++) {
+                sum += src[index[j]] * weight[j];
+                sumw += weight[j];
+            }
+            os << sum / sumw << endl;
+        }
+        os << "}" << endl;
+        src.writeBoundary(os);
+        mapped[src.fName] = os.str();
+    }
+}
+
+}
+/**
+Map fields of a source mesh onto the current mesh.
+Each source cell is given to the one target cell whose faces enclose
+its centre, or to the nearest target cell when none does, and every
+target cell takes the volume weighted average of its source cells.
+Source integrals are thus counted exactly once, and are conserved
+when the target cells are unions of source cells. Cells that receive 
+no source cell, and all DG nodes, take the value of the nearest source 
+point. Boundary conditions come from the target's initial fields when 
+present.
+*/
+int Prepare::mapFields(const string& source,Int step) {
+    using namespace Mesh;
+    
+    vector<string>& fields = BaseField::fieldNames;
+    std::cout << "Mapping fields from " << source 
+              << " at step " << step << std::endl;
+
+    /*target points, bounding boxes and face planes*/
+    char targetDir[PATH_MAX + 1];
+    System::pwd(targetDir,PATH_MAX + 1);
+    LoadMesh(0,true,false);
+    Int NP = DG::NP;
+    Int nt = gBCSfield;
+    VectorVector tC(nt),tMin(nt),tMax(nt),fP,fO;
+    IntVector fStart(nt + 1,0);
+    for(Int i = 0;i < nt;i++) {
+        tC[i] = cC[i];
+        tMin[i] = tMax[i] = cC[i];
+        if(NP == 1 && i < gBCS) {
+            Cell& c = gCells[i];
+            forEach(c,j) {
+                Int fi = c[j];
+                Facet& f = gFacets[fi];
+                forEach(f,k) {
+                    Vector& v = gVertices[f[k]];
+                    tMin[i] = min(tMin[i],v);
+                    tMax[i] = max(tMax[i],v);
+                }
+                fP.push_back(fC[fi]);
+                fO.push_back((gFOC[fi] == i) ? fN[fi] : -fN[fi]);
+            }
+        }
+        fStart[i + 1] = fP.size();
+    }
+    
+    /*load source mesh and fields*/
+    string srcDir = source;
+    if(srcDir[0] != '/')
+        srcDir = string(MP::workingDir) + "/" + srcDir;
+    if(!System::cd(srcDir)) {
+        std::cout << "Source directory " << srcDir << " not found." << std::endl;
+        return 1;
+    }
+    LoadMesh(step,true,false);
+    createFields(fields,step);
+    if(!readFields(fields,step)) {
+        std::cout << "No source fields at step " << step << "." << std::endl;
+        return 1;
+    }
+    Int ns = gBCSfield;
+    VectorVector sC(ns);
+    for(Int i = 0;i < ns;i++)
+        sC[i] = cC[i];
+    PointBins sb(sC);
+    
+    /*give each source cell to the target cell containing its 
+      centre, or to the nearest target cell*/
+    IntVector owner(ns,Int(-1));
+    if(NP == 1) {
+        for(Int i = 0;i < nt;i++) {
+            Int lo[3],hi[3];
+            for(Int j = 0;j < 3;j++) {
+                lo[j] = sb.bin(tMin[i],j);
+                hi[j] = sb.bin(tMax[i],j);
+            }
+            for(Int z = lo[2];z <= hi[2];z++) {
+            for(Int y = lo[1];y <= hi[1];y++) {
+            for(Int x = lo[0];x <= hi[0];x++) {
+                Int b = sb.id(x,y,z);
+                for(Int k = sb.start[b];k < sb.start[b + 1];k++) {
+                    Int s = sb.index[k];
+                    if(owner[s] != Int(-1))
+                        continue;
+                    bool inside = true;
+                    for(Int j = fStart[i];j < fStart[i + 1] && inside;j++) {
+                        if(((sC[s] - fP[j]) & fO[j]) > 0)
+                            inside = false;
+                    }
+                    if(inside)
+                        owner[s] = i;
+                }
+            }
+            }
+            }
+        }
+        PointBins tb(tC);
+        for(Int s = 0;s < ns;s++) {
+            if(owner[s] == Int(-1))
+                owner[s] = tb.nearest(tC,sC[s]);
+        }
+    }
+    
+    /*donor cells and weights*/
+    IntVector start(nt + 1,0);
+    for(Int s = 0;s < ns;s++) {
+        if(owner[s] != Int(-1))
+            start[owner[s] + 1]++;
+    }
+    for(Int i = 0;i < nt;i++)
+        start[i + 1] = start[i] + max(start[i + 1],Int(1));
+    IntVector index(start[nt]);
+    ScalarVector weight(start[nt]);
+    IntVector pos(start.begin(),start.end() - 1);
+    for(Int s = 0;s < ns;s++) {
+        if(owner[s] != Int(-1)) {
+            index[pos[owner[s]]] = s;
+            weight[pos[owner[s]]++] = cV[s];
+        }
+    }
+    for(Int i = 0;i < nt;i++) {
+        if(pos[i] == start[i]) {
+            index[pos[i]] = sb.nearest(sC,tC[i]);
+            weight[pos[i]] = 1;
+        }
+    }
+
+    /*map fields*/
+    map<string,string> mapped;
+    mapCellFields<Scalar>(mapped,start,index,weight);
+    mapCellFields<Vector>(mapped,start,index,weight);
+    mapCellFields<STensor>(mapped,start,index,weight);
+    mapCellFields<Tensor>(mapped,start,index,weight);
+    
+    /*back to target*/
+    System::cd(targetDir);
+    LoadMesh(0,true,false);
+    createFields(fields,0);
+    readFields(fields,0);
+    for(map<string,string>::iterator it = mapped.begin();
+        it != mapped.end(); ++it) {
+        stringstream is(it->second);
+        BaseField* bf = BaseField::findField(it->first);
+        if(bf) {
+            bf->readInternal(is,0);
+        } else {
+            string str;
+            Int size;
+            is >> str >> size;
+            is.seekg(0);
+            switch(size) {
+                case 1 :  bf = new ScalarCellField(it->first.c_str(),READWRITE,false); break;
+                case 3 :  bf = new VectorCellField(it->first.c_str(),READWRITE,false); break;
+                case 6 :  bf = new STensorCellField(it->first.c_str(),READWRITE,false); break;
+                case 9 :  bf = new TensorCellField(it->first.c_str(),READWRITE,false); break;
+            }
+            bf->readInternal(is,0);
+            bf->readBoundary(is);
+        }
+    }
+    write_fields(step);
+
+    /*destroy*/ 
+    BaseField::destroyFields();
+
+    return 0;
+}
@@ -190,6 +190,8 @@ struct BCondition : public BasicBCondition {
         cIndex = Util::hash_function(cname);
     }
 };
+/** Boundary conditions of a scalar field by boundary name */
+typedef std::map<std::string,BCondition<Scalar>*> BConditionMap;
 /** Write boundary conditions */
 template <class type> 
 std::ostream& operator << (std::ostream& os, const BCondition<type>& p) {
@@ -325,7 +327,15 @@ namespace Controls {
         NOPR,   /**< No preconditioner */
         DIAG,   /**< Diagonal (Jacobi) preconditioner */
         SSOR,   /**< Symmetric SOR preconditioner */
-        DILU    /**< Diagonal incomplete LU factorization */
+        DILU,   /**< Diagonal incomplete LU factorization */
+        GMG,    /**< Geometric multigrid */
+        BJAC,   /**< Element block Jacobi */
+        BILU    /**< Element block ILU(0) */
+    };
+    /** Multigrid cycles */
+    enum MgCycle {
+        V_CYCLE,    /**< V-cycle */
+        W_CYCLE     /**< W-cycle */
     };
     /** Communication methods */
     enum CommMethod {
@@ -344,6 +354,7 @@ namespace Controls {
     extern TimeScheme time_scheme;
     extern Solvers Solver; 
     extern Preconditioners Preconditioner;
+    extern MgCycle mg_cycle;
     extern CommMethod parallel_method;
     extern State state;
 
@@ -353,8 +364,13 @@ namespace Controls {
     extern Scalar implicit_factor;
     extern Scalar dt;
     extern Int runge_kutta;
+    extern Int matrix_free;
+    extern Scalar CFL;
+    extern Int lts_levels;
+    extern Int imex;
     
     extern Int max_iterations;
+    extern Int mg_sweeps;
     extern Int write_interval;
     extern Int start_step;
     extern Int end_step;
@@ -362,6 +378,8 @@ namespace Controls {
     extern Int n_deferred;
     extern Int save_average;
     extern Int print_time;
+    extern Scalar steady_tolerance;
+    extern Int steady_steps;
 
     extern Vector gravity;
 }
@@ -451,27 +469,31 @@ public:
         fName = str;
         construct(str,a,recycle);
     }
-    MeshField(const MeshField& p) : allocated(0) {
+    MeshField(const MeshField& p) : allocated(0),access(NO) {
         allocate(); 
         forEach(*this,i)
             P[i] = p[i];
     }
-    MeshField(const type& p) : allocated(0) {
+    MeshField(const type& p) : allocated(0),access(NO) {
         allocate(); 
         forEach(*this,i)
             P[i] = p;
     }
-    explicit MeshField(const bool) : allocated(0) {
+    explicit MeshField(const bool) : allocated(0),access(NO) {
     }
     /*allocators*/
+    static Int entitySize() {
+        switch(entity) {
+            case CELL:   return Mesh::gCells.size() * DG::NP;
+            case FACET:  return Mesh::gFacets.size() * DG::NPF;
+            case VERTEX: return Mesh::gVertices.size();
+            case CELLMAT:return Mesh::gCells.size() * DG::NPMAT;
+        }
+        return 0;
+    }
     void allocate(bool recycle = true) {
         if(!recycle || mem_pool.empty()) {
-            switch(entity) {
-                case CELL:   SIZE = Mesh::gCells.size() * DG::NP;    break;
-                case FACET:  SIZE = Mesh::gFacets.size() * DG::NPF;  break;
-                case VERTEX: SIZE = Mesh::gVertices.size();          break;
-                case CELLMAT:SIZE = Mesh::gCells.size() * DG::NPMAT; break;
-            }
+            SIZE = entitySize();
             Int sz = SIZE;
             if(entity == CELL) 
                 sz += 1;
@@ -559,7 +581,7 @@ public:
         
     /*Assignment from expressions*/
     template <class A>
-    MeshField(const DVExpr<type,A>& p) {
+    MeshField(const DVExpr<type,A>& p) : access(NO) {
         allocate();
         forEach(*this,i)
             P[i] = p[i];
@@ -659,10 +681,11 @@ public:
             }
         }
     }
-    /*Store previous values*/
+    /*Store previous values in a ring buffer, newest at thead*/
     MeshField* tstore;
     Int nstore;
     Int nstored;
+    Int thead;
     void initStore() {
         nstore = Controls::time_scheme - Controls::BDF1 + 1;
         tstore = new MeshField[nstore];
@@ -670,20 +693,26 @@ public:
         for(int i = 0;i < nstore;i++)
             tstore[i] = *this;
         nstored = 0;
+        thead = 0;
     }
     void updateStore() {
-        for(int i = 0;i < nstore - 1;i++)
-            tstore[nstore - i - 1] = tstore[nstore - i - 2];
-        tstore[0] = *this;
+        thead = (thead + nstore - 1) % nstore;
+        tstore[thead] = *this;
         nstored++;
     }
+    /** Value k steps back in time, 0 being the last stored step */
+    MeshField& tprev(Int k) const {
+        return tstore[(thead + k) % nstore];
+    }
     /*Time history*/
     static std::vector<std::ofstream*> tseries;
     static std::vector<MeshField*> tavgs;
     static std::vector<MeshField*> tstds;
+    static std::vector<type> tprobes;
     
     static void initTimeSeries() {
         MeshField<type,CELL>* pf;
+        tprobes.clear();
         forEachIt(typename std::list<MeshField*>, fields_, it) {
             pf = *it;
             if(pf->access & WRITE) {
@@ -731,6 +760,30 @@ public:
             }
         }
     }
+    /*relative change of probed values since the last call*/
+    static void probeChange(Scalar& change) {
+        Int count = 0;
+        MeshField<type,CELL>* pf;
+        forEachIt(typename std::list<MeshField*>, fields_, it) {
+            pf = *it;
+            if((pf->access & WRITE) && Mesh::probeCells.size()) {
+                Scalar dmax = 0, vmax = 0;
+                forEach(Mesh::probeCells,j) {
+                    type v = (*pf)[Mesh::probeCells[j]];
+                    if(count < tprobes.size()) {
+                        dmax = max(dmax,mag(v - tprobes[count]));
+                        tprobes[count] = v;
+                    } else {
+                        dmax = max(dmax,mag(v) + 1);
+                        tprobes.push_back(v);
+                    }
+                    vmax = max(vmax,mag(v));
+                    count++;
+                }
+                change = max(change,sdiv(dmax,vmax));
+            }
+        }
+    }
     /*refine/unrefine field*/
     void refineField(Int step,IntVector& refineMap,IntVector& coarseMap) {
         forEach(coarseMap,i) {
@@ -828,10 +881,92 @@ std::vector<MeshField<T,E>*> MeshField<T,E>::tavgs;
 template <class T,ENTITY E>
 std::vector<MeshField<T,E>*> MeshField<T,E>::tstds;
 
+template <class T,ENTITY E>
+std::vector<T> MeshField<T,E>::tprobes;
+
 template <class T,ENTITY E> 
 typename MeshField<T,E>::vertexFieldsType* MeshField<T,E>::vf_fields_;
 //@}
 
+/* *****************************************************************************
+ *                    Fields stored in single precision
+ * *****************************************************************************/
+
+/** Reads values of a single precision field as type */
+template <class type>
+class FloatIter {
+    const float* P;
+public:
+    static const Int N = sizeof(type) / sizeof(Scalar);
+    FloatIter(const float* p = 0) : P(p) {
+    }
+    type operator[](Int i) const {
+        type r;
+        Scalar* q = (Scalar*)&r;
+        for(Int j = 0;j < N;j++)
+            q[j] = P[i * N + j];
+        return r;
+    }
+};
+
+/**
+ Field of secondary data stored in single precision. It is read by the 
+ expression templates like a MeshField, with values converted to type on 
+ load and rounded on store, so that all arithmetic stays in Scalar. It 
+ has no boundary conditions, IO or time store of its own.
+ */
+template <class type,ENTITY entity> 
+class FloatField : public DVExpr<type,FloatIter<type> >
+{
+private:
+    using DVExpr<type,FloatIter<type> >::P;
+    static const Int N = FloatIter<type>::N;
+    std::vector<float> store;
+public:
+    /*constructors*/
+    FloatField() {
+    }
+    explicit FloatField(const type& p) {
+        *this = p;
+    }
+    FloatField(const FloatField& p) : store(p.store) {
+        P = FloatIter<type>(store.empty() ? 0 : &store[0]);
+    }
+    /*accessors*/
+    Int size() const {
+        return store.size() / N;
+    }
+    void allocate() {
+        store.resize(MeshField<type,entity>::entitySize() * N);
+        P = FloatIter<type>(store.empty() ? 0 : &store[0]);
+    }
+    /*assignment*/
+    FloatField& operator = (const FloatField& p) {
+        store = p.store;
+        P = FloatIter<type>(store.empty() ? 0 : &store[0]);
+        return *this;
+    }
+    FloatField& operator = (const type& p) {
+        allocate();
+        const Scalar* q = (const Scalar*)&p;
+        for(Int i = 0;i < store.size();i++)
+            store[i] = float(q[i % N]);
+        return *this;
+    }
+    template <class A>
+    FloatField& operator = (const DVExpr<type,A>& p) {
+        allocate();
+        Int sz = size();
+        for(Int i = 0;i < sz;i++) {
+            type v = p[i];
+            const Scalar* q = (const Scalar*)&v;
+            for(Int j = 0;j < N;j++)
+                store[i * N + j] = float(q[j]);
+        }
+        return *this;
+    }
+};
+
 /* ***************************************
  * global mesh fields
  * ***************************************/
@@ -843,9 +978,10 @@ namespace Mesh {
     extern ScalarCellField   cV;
     extern ScalarFacetField  fI;
     extern ScalarFacetField  fD;
-    extern ScalarCellField   yWall;
+    extern FloatField<Scalar,CELL> yWall;
     extern IntVector         FO;
     extern IntVector         FN; 
+    extern bool              reuseMesh;
     
     bool   LoadMesh(Int = 0,bool = true, bool = true);
     void   initGeomMeshFields();
@@ -869,7 +1005,8 @@ namespace Prepare {
     void calcQOI(VectorCellField&);
     void initRefineThreshold();
     int decomposeMesh(Int);
-    int mergeFields(Int);
+    int mergeFields(Int,int = -1);
+    int mapFields(const std::string&,Int);
 }
 
 /** central difference scheme */
@@ -1574,48 +1711,75 @@ MeshField<T1,CELL> getRHS(const MeshMatrix<T1,T2,T3>& p, const bool sync = false
  * Apply boundary conditions
  * ***************************/
 
-/** Apply implicit boundary conditions */
+/** 
+ Apply implicit boundary conditions. These are the conditions of cF, or
+ when bcs is given, those of the scalars packed into its components, 
+ which must have the same types of conditions on each boundary.
+ */
 template <class T1, class T2, class T3> 
-void applyImplicitBCs(const MeshMatrix<T1,T2,T3>& M) {
+void applyImplicitBCs(const MeshMatrix<T1,T2,T3>& M,
+                      const std::vector<BConditionMap>* bcs = 0) {
      using namespace Mesh;
      MeshField<T1,CELL>& cF = *M.cF;
      BasicBCondition* bbc;
-     BCondition<T1>* bc;
+     BCondition<T1>* bc = 0;
+     std::vector<BCondition<Scalar>*> cbc;
 
      /*boundary conditions*/
      forEach(AllBConditions,i) {
          bbc = AllBConditions[i];
-         if(bbc->fIndex == cF.fIndex) {
-             if(bbc->cIndex == GHOST)
-                continue;
-
+         if(bbc->cIndex == GHOST)
+            continue;
+         if(bcs) {
+             BConditionMap::const_iterator it = (*bcs)[0].find(bbc->bname);
+             if(it == (*bcs)[0].end() || it->second != bbc)
+                 continue;
+             cbc.resize(bcs->size());
+             forEach(*bcs,m)
+                 cbc[m] = (*bcs)[m].find(bbc->bname)->second;
+         } else if(bbc->fIndex == cF.fIndex) {
              bc = static_cast<BCondition<T1>*> (bbc);
-             Int sz = bc->bdry->size();
-             if(sz == 0) continue;
-
-             for(Int j = 0;j < sz;j++) {
-                 Int faceid = (*bc->bdry)[j];
-                 for(Int n = 0; n < DG::NPF;n++) {
-                     Int k = faceid * DG::NPF + n;
-                     
-                     Int c1 = FO[k];
-                     Int c2 = FN[k];
-                     /*break connection with boundary cells*/
-                     if(bc->cIndex == NEUMANN || bc->cIndex == SYMMETRY ||
-                        bc->cIndex == CYCLIC || bc->cIndex == RECYCLE) {
-                         M.ap[c1] -= M.an[1][k];
-                         M.Su[c1] += M.an[1][k] * (cF[c2] - cF[c1]);
-                         M.an[1][k] = 0;
-                     } else if(bc->cIndex == ROBIN) {
-                         Vector dv = cC[c2] - cC[c1];
-                         M.ap[c1] -= (1 - bc->shape) * M.an[1][k];
-                         M.Su[c1] += M.an[1][k] * (bc->shape * bc->value + 
-                             (1 - bc->shape) * bc->tvalue * mag(dv));
-                         M.an[1][k] = 0;
+         } else
+             continue;
+
+         Int sz = bbc->bdry->size();
+         if(sz == 0) continue;
+
+         for(Int j = 0;j < sz;j++) {
+             Int faceid = (*bbc->bdry)[j];
+             for(Int n = 0; n < DG::NPF;n++) {
+                 Int k = faceid * DG::NPF + n;
+                 
+                 Int c1 = FO[k];
+                 Int c2 = FN[k];
+                 /*break connection with boundary cells*/
+                 if(bbc->cIndex == NEUMANN || bbc->cIndex == SYMMETRY ||
+                    bbc->cIndex == CYCLIC || bbc->cIndex == RECYCLE) {
+                     M.ap[c1] -= M.an[1][k];
+                     M.Su[c1] += M.an[1][k] * (cF[c2] - cF[c1]);
+                     M.an[1][k] = 0;
+                 } else if(bbc->cIndex == ROBIN) {
+                     Vector dv = cC[c2] - cC[c1];
+                     Scalar shape;
+                     T1 v = T1(0);
+                     if(bcs) {
+                         /*value of each component from its scalar*/
+                         Scalar* q = (Scalar*)&v;
+                         shape = cbc[0]->shape;
+                         forEach(cbc,m)
+                             q[m] = cbc[m]->shape * cbc[m]->value + 
+                                 (1 - cbc[m]->shape) * cbc[m]->tvalue * mag(dv);
                      } else {
-                         M.Su[c1] += M.an[1][k] * cF[c2];
-                         M.an[1][k] = 0;
+                         shape = bc->shape;
+                         v = bc->shape * bc->value + 
+                             (1 - bc->shape) * bc->tvalue * mag(dv);
                      }
+                     M.ap[c1] -= (1 - shape) * M.an[1][k];
+                     M.Su[c1] += M.an[1][k] * v;
+                     M.an[1][k] = 0;
+                 } else {
+                     M.Su[c1] += M.an[1][k] * cF[c2];
+                     M.an[1][k] = 0;
                  }
              }
          }
@@ -1864,9 +2028,10 @@ inline MeshField<T1,CELL> gradf(const MeshField<T2,CELL>& p) {
                                                                                             \
     if(NPMAT) {                                                                             \
         for(Int ci = 0; ci < gBCS;ci++) {                                                   \
+            JACOBIAN(ci);                                                                   \
             forEachLgl(ii,jj,kk) {                                                          \
                 Int index = INDEX4(ci,ii,jj,kk);                                            \
-                Tensor Jin = Jinv[index] * cV[index];                                       \
+                Tensor Jin = JINV(ii,jj,kk) * cV[index];                                    \
                 forEachLglX(i) GRADD(i,jj,kk);                                              \
                 forEachLglY(j) if(j != jj) GRADD(ii,j,kk);                                  \
                 forEachLglZ(k) if(k != kk) GRADD(ii,jj,k);                                  \
@@ -1886,6 +2051,140 @@ GRAD(Tensor,Vector);
 
 #define gradi(x) (gradf(x)  / Mesh::cV)
 
+/**
+ Blending factor of central and upwind schemes
+ */
+template<class T4>
+ScalarFacetField blendFactor(const MeshField<T4,FACET>& flux, const MeshField<T4,CELL>* muc = 0) {
+    using namespace Controls;
+    using namespace Mesh;
+    using namespace DG;
+    T4 F;
+    ScalarFacetField gamma;
+    if(convection_scheme == CDS) 
+        gamma = Scalar(1);
+    else if(convection_scheme == UDS) 
+        gamma = Scalar(0);
+    else if(convection_scheme == BLENDED) 
+        gamma = Scalar(blend_factor);
+    else if(!muc)
+        gamma = Scalar(1);
+    else if(convection_scheme == HYBRID) {
+        MeshField<T4,FACET> mu = cds(*muc);
+        forEach(gFacets,faceid) {
+            for(Int n = 0; n < NPF;n++) {
+                Int k = faceid * NPF + n;
+                //compare F and D
+                T4 D = fD[k] * mu[k];
+                F = flux[k];
+                if(dot(F,T4(1)) < 0) {
+                    if(dot(F * fI[k] + D,T4(1)) >= 0) gamma[k] = 1;
+                    else gamma[k] = 0;
+                } else {
+                    if(dot(F * (1 - fI[k]) - D,T4(1)) > 0) gamma[k] = 0;
+                    else gamma[k] = 1;
+                }
+            }
+        }
+    }
+    return gamma;
+}
+/**
+ Deferred correction to upwind face values
+ */
+template<class T1, class T4>
+MeshField<T1,FACET> deferredCorrection(const MeshField<T1,CELL>& cF, const MeshField<T4,FACET>& flux) {
+    using namespace Controls;
+    using namespace Mesh;
+    Scalar G;
+    MeshField<T1,FACET> corr;
+    if(convection_scheme == CDSS) {
+        corr = cds(cF) - uds(cF,flux);
+    } else if(convection_scheme == LUD) {
+        VectorFacetField R = fC - uds(cC,flux);
+        corr = dot(uds(gradi(cF),flux),R);
+    } else if(convection_scheme == MUSCL) {
+        VectorFacetField R = fC - uds(cC,flux);
+        corr  = (  blend_factor  ) * (cds(cF) - uds(cF,flux));
+        corr += (1 - blend_factor) * (dot(uds(gradi(cF),flux),R));
+    } else {
+        /*
+        TVD schemes
+        ~~~~~~~~~~~
+        Reference:
+            M.S Darwish and F Moukalled "TVD schemes for unstructured grids"
+            Versteeg and Malaskara
+        Description:
+            phi = phiU + psi(r) * [(phiD - phiC) * (1 - fi)]
+        Schemes
+            psi(r) = 0 =>UDS
+            psi(r) = 1 =>CDS
+        R is calculated as ratio of upwind and downwind gradient
+            r = phiDC / phiCU
+        Further modification to unstructured grid to better fit LUD scheme
+            r = (phiDC / phiCU) * (fi / (1 - fi))
+        */
+        /*calculate r*/
+        MeshField<T1,FACET> q,r,phiDC,phiCU;
+        ScalarFacetField uFI;
+        {
+            MeshField<T4,FACET> nflux = T4(0)-flux;
+            phiDC = uds(cF,nflux) - uds(cF,flux);
+            forEach(phiDC,i) {
+                if(dot(flux[i],T4(1)) >= 0) G = fI[i];
+                else G = 1 - fI[i];
+                uFI[i] = G;
+            }
+            /*Bruner's or Darwish way of calculating r*/
+            if(TVDbruner) {
+                VectorFacetField R = fC - uds(cC,flux);
+                phiCU = 2 * (dot(uds(gradi(cF),flux),R));
+            } else {
+                VectorFacetField R = uds(cC,nflux) - uds(cC,flux);
+                phiCU = 2 * (dot(uds(gradi(cF),flux),R)) - phiDC;
+            }
+            /*end*/
+        }
+        r = (phiCU / phiDC) * (uFI / (1 - uFI));
+        forEach(phiDC,i) {
+            if(equal(phiDC[i] * (1 - uFI[i]),T1(0)))
+                r[i] = T1(0);
+        }
+        /*TVD schemes*/
+        if(convection_scheme == VANLEER) {
+            q = (r+fabs(r)) / (1+r);
+        } else if(convection_scheme == VANALBADA) {
+            q = (r+r*r) / (1+r*r);
+        } else if(convection_scheme == MINMOD) {
+            q = max(T1(0),min(r,T1(1)));
+        } else if(convection_scheme == SUPERBEE) {
+            q = max(min(r,T1(2)),min(2*r,T1(1)));
+            q = max(q,T1(0));
+        } else if(convection_scheme == SWEBY) {
+            Scalar beta = 2;
+            q = max(min(r,T1(beta)),min(beta*r,T1(1)));
+            q = max(q,T1(0));
+        } else if(convection_scheme == QUICKL) {
+            q = min(2*r,(3+r)/4);
+            q = min(q,T1(2));
+            q = max(q,T1(0));
+        } else if(convection_scheme == UMIST) {
+            q = min(2*r,(3+r)/4);
+            q = min(q,(1+3*r)/4);
+            q = min(q,T1(2));
+            q = max(q,T1(0));
+        } else if(convection_scheme == QUICK) {
+            q = (3+r)/4;
+        } else if(convection_scheme == DDS) {
+            q = 2;
+        } else if(convection_scheme == FROMM) {
+            q = (1+r)/2;
+        }
+        corr = q * phiDC * (1 - uFI);
+        /*end*/
+    }
+    return corr;
+}
 /**
  Compute numerical flux
  */
@@ -1907,33 +2206,7 @@ void numericalFlux(MeshMatrix<T1,T2,T3>& m, const MeshField<T4,FACET>& flux, con
         convection_scheme == HYBRID );
 
     if(isImplicit) {
-        ScalarFacetField gamma;
-        if(convection_scheme == CDS) 
-            gamma = Scalar(1);
-        else if(convection_scheme == UDS) 
-            gamma = Scalar(0);
-        else if(convection_scheme == BLENDED) 
-            gamma = Scalar(blend_factor);
-        else if(!muc)
-            gamma = Scalar(1);
-        else if(convection_scheme == HYBRID) {
-            MeshField<T4,FACET> mu = cds(*muc);
-            forEach(gFacets,faceid) {
-                for(Int n = 0; n < NPF;n++) {
-                    Int k = faceid * NPF + n;
-                    //compare F and D
-                    T4 D = fD[k] * mu[k];
-                    F = flux[k];
-                    if(dot(F,T4(1)) < 0) {
-                        if(dot(F * fI[k] + D,T4(1)) >= 0) gamma[k] = 1;
-                        else gamma[k] = 0;
-                    } else {
-                        if(dot(F * (1 - fI[k]) - D,T4(1)) > 0) gamma[k] = 0;
-                        else gamma[k] = 1;
-                    }
-                }
-            }
-        }
+        ScalarFacetField gamma = blendFactor(flux,muc);
         forEach(flux,i) {
             F = flux[i];
             G = gamma[i];
@@ -1952,93 +2225,7 @@ void numericalFlux(MeshMatrix<T1,T2,T3>& m, const MeshField<T4,FACET>& flux, con
             m.ap[FN[i]] += m.an[1][i];
         }
 
-        MeshField<T1,FACET> corr;
-        if(convection_scheme == CDSS) {
-            corr = cds(cF) - uds(cF,flux);
-        } else if(convection_scheme == LUD) {
-            VectorFacetField R = fC - uds(cC,flux);
-            corr = dot(uds(gradi(cF),flux),R);
-        } else if(convection_scheme == MUSCL) {
-            VectorFacetField R = fC - uds(cC,flux);
-            corr  = (  blend_factor  ) * (cds(cF) - uds(cF,flux));
-            corr += (1 - blend_factor) * (dot(uds(gradi(cF),flux),R));
-        } else {
-            /*
-            TVD schemes
-            ~~~~~~~~~~~
-            Reference:
-                M.S Darwish and F Moukalled "TVD schemes for unstructured grids"
-                Versteeg and Malaskara
-            Description:
-                phi = phiU + psi(r) * [(phiD - phiC) * (1 - fi)]
-            Schemes
-                psi(r) = 0 =>UDS
-                psi(r) = 1 =>CDS
-            R is calculated as ratio of upwind and downwind gradient
-                r = phiDC / phiCU
-            Further modification to unstructured grid to better fit LUD scheme
-                r = (phiDC / phiCU) * (fi / (1 - fi))
-            */
-            /*calculate r*/
-            MeshField<T1,FACET> q,r,phiDC,phiCU;
-            ScalarFacetField uFI;
-            {
-                MeshField<T4,FACET> nflux = T4(0)-flux;
-                phiDC = uds(cF,nflux) - uds(cF,flux);
-                forEach(phiDC,i) {
-                    if(dot(flux[i],T4(1)) >= 0) G = fI[i];
-                    else G = 1 - fI[i];
-                    uFI[i] = G;
-                }
-                /*Bruner's or Darwish way of calculating r*/
-                if(TVDbruner) {
-                    VectorFacetField R = fC - uds(cC,flux);
-                    phiCU = 2 * (dot(uds(gradi(cF),flux),R));
-                } else {
-                    VectorFacetField R = uds(cC,nflux) - uds(cC,flux);
-                    phiCU = 2 * (dot(uds(gradi(cF),flux),R)) - phiDC;
-                }
-                /*end*/
-            }
-            r = (phiCU / phiDC) * (uFI / (1 - uFI));
-            forEach(phiDC,i) {
-                if(equal(phiDC[i] * (1 - uFI[i]),T1(0)))
-                    r[i] = T1(0);
-            }
-            /*TVD schemes*/
-            if(convection_scheme == VANLEER) {
-                q = (r+fabs(r)) / (1+r);
-            } else if(convection_scheme == VANALBADA) {
-                q = (r+r*r) / (1+r*r);
-            } else if(convection_scheme == MINMOD) {
-                q = max(T1(0),min(r,T1(1)));
-            } else if(convection_scheme == SUPERBEE) {
-                q = max(min(r,T1(2)),min(2*r,T1(1)));
-                q = max(q,T1(0));
-            } else if(convection_scheme == SWEBY) {
-                Scalar beta = 2;
-                q = max(min(r,T1(beta)),min(beta*r,T1(1)));
-                q = max(q,T1(0));
-            } else if(convection_scheme == QUICKL) {
-                q = min(2*r,(3+r)/4);
-                q = min(q,T1(2));
-                q = max(q,T1(0));
-            } else if(convection_scheme == UMIST) {
-                q = min(2*r,(3+r)/4);
-                q = min(q,(1+3*r)/4);
-                q = min(q,T1(2));
-                q = max(q,T1(0));
-            } else if(convection_scheme == QUICK) {
-                q = (3+r)/4;
-            } else if(convection_scheme == DDS) {
-                q = 2;
-            } else if(convection_scheme == FROMM) {
-                q = (1+r)/2;
-            }
-            corr = q * phiDC * (1 - uFI);
-            /*end*/
-        }
-        m.Su = sum(flux * corr);
+        m.Su = sum(flux * deferredCorrection(cF,flux));
     }
 }
 
@@ -2060,9 +2247,10 @@ MeshMatrix<T1,T2,T2> grad(MeshField<T1,CELL>& cF,const MeshField<T1,CELL>& flux_
     /*compute volume integral*/
     if(NPMAT) {
         for(Int ci = 0; ci < gBCS;ci++) {
+            JACOBIAN(ci);
             forEachLgl(ii,jj,kk) {
                 Int index = INDEX4(ci,ii,jj,kk);
-                Tensor Jr = Jinv[index];
+                Tensor Jr = JINV(ii,jj,kk);
                 T1 F = flux_cell[index] * cV[index];
 
 #define GRADD(im,jm,km) {                                   \
@@ -2125,9 +2313,10 @@ inline MeshField<T1,CELL> divf(const MeshField<T2,CELL>& p) {
                                                                                             \
     if(NPMAT) {                                                                             \
         for(Int ci = 0; ci < gBCS;ci++) {                                                   \
+            JACOBIAN(ci);                                                                   \
             forEachLgl(ii,jj,kk) {                                                          \
                 Int index = INDEX4(ci,ii,jj,kk);                                            \
-                Tensor Jin = Jinv[index] * cV[index];                                       \
+                Tensor Jin = JINV(ii,jj,kk) * cV[index];                                    \
                 forEachLglX(i) DIVD(i,jj,kk);                                               \
                 forEachLglY(j) if(j != jj) DIVD(ii,j,kk);                                   \
                 forEachLglZ(k) if(k != kk) DIVD(ii,jj,k);                                   \
@@ -2166,9 +2355,10 @@ MeshMatrix<type> div(MeshField<type,CELL>& cF,const VectorCellField& flux_cell,
     /*compute volume integral*/
     if(NPMAT) {
         for(Int ci = 0; ci < gBCS;ci++) {
+            JACOBIAN(ci);
             forEachLgl(ii,jj,kk) {
                 Int index = INDEX4(ci,ii,jj,kk);
-                Vector Jr = dot(Jinv[index],flux_cell[index]) * cV[index];
+                Vector Jr = dot(JINV(ii,jj,kk),flux_cell[index]) * cV[index];
 
 #define DIVD(im,jm,km) {                                    \
     Int index2 = INDEX4(ci,im,jm,km);                       \
@@ -2259,9 +2449,10 @@ MeshMatrix<type> lap(MeshField<type,CELL>& cF,const ScalarCellField& muc, const
         
         /*compute volume integral*/
         for(Int ci = 0; ci < gBCS;ci++) {
+            JACOBIAN(ci);
             forEachLgl(ii,jj,kk) {
                 Int index = INDEX4(ci,ii,jj,kk);
-                Tensor Jin = Jinv[index];
+                Tensor Jin = JINV(ii,jj,kk);
 
 #define H(in,jn,kn) {                               \
     Int index2 = INDEX4(ci,in,jn,kn);               \
@@ -2342,7 +2533,36 @@ MeshMatrix<type> lap(MeshField<type,CELL>& cF,const ScalarCellField& muc, const
 /* *******************************
  * Temporal derivative
  * *******************************/
-#define PREV(k) (rho ? (cF.tstore[k] * rho->tstore[k]) : cF.tstore[k])
+
+/** 
+Weighted sum of n previous time levels, density weighted if rho is given,
+scaled by the diagonal. All levels are combined in a single pass.
+*/
+template<class type>
+void addPrevious(MeshMatrix<type>& m,MeshField<type,CELL>& cF,ScalarCellField* rho,
+                 const Scalar* w,Int n) {
+    const type* c[6];
+    const Scalar* r[6];
+    for(Int k = 0;k < n;k++) {
+        c[k] = &cF.tprev(k)[0];
+        r[k] = rho ? &rho->tprev(k)[0] : 0;
+    }
+    if(rho) {
+        forEach(m.Su,i) {
+            type s = c[0][i] * (r[0][i] * w[0]);
+            for(Int k = 1;k < n;k++)
+                s += c[k][i] * (r[k][i] * w[k]);
+            m.Su[i] = s * m.ap[i];
+        }
+    } else {
+        forEach(m.Su,i) {
+            type s = c[0][i] * w[0];
+            for(Int k = 1;k < n;k++)
+                s += c[k][i] * w[k];
+            m.Su[i] = s * m.ap[i];
+        }
+    }
+}
 
 /** First derivative with respect to time */
 template<class type>
@@ -2351,26 +2571,18 @@ MeshMatrix<type> ddt(MeshField<type,CELL>& cF,ScalarCellField* rho) {
     m.cF = &cF;
     m.flags |= (m.SYMMETRIC | m.DIAGONAL);
     
-    //BDF methods
-    if(Controls::time_scheme == Controls::BDF1) {
-        m.ap = (-1.0 / Controls::dt) * Mesh::cV;
-        m.Su = (PREV(0)) * m.ap;
-    } else if(Controls::time_scheme == Controls::BDF2) {
-        m.ap = (-3.0 / (2.0 * Controls::dt)) * Mesh::cV;
-        m.Su = ((4.0 * PREV(0) - PREV(1)) / 3.0) * m.ap;
-    } else if(Controls::time_scheme == Controls::BDF3) {
-        m.ap = (-11.0 / (6.0 * Controls::dt)) * Mesh::cV;
-        m.Su = ((18.0 * PREV(0) - 9.0 * PREV(1) + 2.0 * PREV(2)) / 11.0) * m.ap;
-    } else if(Controls::time_scheme == Controls::BDF4) {
-        m.ap = (-25.0 / (12.0 * Controls::dt)) * Mesh::cV;
-        m.Su = ((48.0 * PREV(0) - 36.0 * PREV(1) + 16.0 * PREV(2) - 3.0 * PREV(3)) / 25.0) * m.ap;
-    } else if(Controls::time_scheme == Controls::BDF5) {
-        m.ap = (-137.0 / (60.0 * Controls::dt)) * Mesh::cV;
-        m.Su = ((300.0 * PREV(0) - 300.0 * PREV(1) + 200.0 * PREV(2) - 75.0 * PREV(3) + 12.0 * PREV(4)) / 137.0) * m.ap;
-    } else if(Controls::time_scheme == Controls::BDF6) {
-        m.ap = (-147.0 / (60.0 * Controls::dt)) * Mesh::cV;
-        m.Su = ((360.0 * PREV(0) - 450.0 * PREV(1) + 400.0 * PREV(2) - 225.0 * PREV(3) + 72.0 * PREV(4) - 10.0 * PREV(5)) / 147.0) * m.ap;
-    }
+    //BDF methods: diagonal followed by weights of previous levels
+    static const Scalar bdf[6][7] = {
+        {1.0,       1.0},
+        {3.0 / 2,   4.0 / 3, -1.0 / 3},
+        {11.0 / 6,  18.0 / 11, -9.0 / 11, 2.0 / 11},
+        {25.0 / 12, 48.0 / 25, -36.0 / 25, 16.0 / 25, -3.0 / 25},
+        {137.0 / 60,300.0 / 137, -300.0 / 137, 200.0 / 137, -75.0 / 137, 12.0 / 137},
+        {147.0 / 60,360.0 / 147, -450.0 / 147, 400.0 / 147, -225.0 / 147, 72.0 / 147, -10.0 / 147}
+    };
+    Int order = Controls::time_scheme - Controls::BDF1;
+    m.ap = (-bdf[order][0] / Controls::dt) * Mesh::cV;
+    addPrevious(m,cF,rho,&bdf[order][1],order + 1);
     if(rho) m.ap *= (*rho);
     
     //others
@@ -2389,12 +2601,14 @@ MeshMatrix<type> ddt2(MeshField<type,CELL>& cF, ScalarCellField* rho) {
     m.flags |= (m.SYMMETRIC | m.DIAGONAL);
 
     //BDF method
+    static const Scalar w2[2] = {2.0, -1.0};
+    static const Scalar w3[3] = {5.0 / 2, -4.0 / 2, 1.0 / 2};
     if(Controls::time_scheme == Controls::BDF2) {
         m.ap = (-1.0 / (Controls::dt * Controls::dt)) * Mesh::cV;
-        m.Su = (2.0 * PREV(0) - PREV(1)) * m.ap;
+        addPrevious(m,cF,rho,w2,2);
     } else if(Controls::time_scheme == Controls::BDF3) {
         m.ap = (-2.0 / (Controls::dt * Controls::dt)) * Mesh::cV;
-        m.Su = ((5.0 * PREV(0) - 4.0 * PREV(1) + PREV(2)) / 2.0) * m.ap;
+        addPrevious(m,cF,rho,w3,3);
     }
     if(rho) m.ap *= (*rho);
 
@@ -2406,8 +2620,6 @@ MeshMatrix<type> ddt2(MeshField<type,CELL>& cF, ScalarCellField* rho) {
     return m;
 }   
 
-#undef PREV
-
 /** Time stepper */
 template<int order, class type>
 void addTemporal(MeshMatrix<type>& M,Scalar cF_UR,ScalarCellField* rho = 0) {
@@ -2418,10 +2630,12 @@ void addTemporal(MeshMatrix<type>& M,Scalar cF_UR,ScalarCellField* rho = 0) {
         //store previous values
         if(!(M.cF->access & STOREPREV)) 
             M.cF->initStore();
+        if(rho && !(rho->access & STOREPREV)) 
+            rho->initStore();
         
         //Multistage Runge-Kutta for linearized (constant jacobian)
         if(!equal(implicit_factor,1)) {
-            MeshField<type, CELL> k1 = M.Su - mul(M,  M.cF->tstore[0]);
+            MeshField<type, CELL> k1 = M.Su - mul(M,  M.cF->tprev(0));
             if(runge_kutta == 1) {
                 MeshField<type, CELL> val = k1  * (1 - implicit_factor);
                 M = M * (implicit_factor) + val;
@@ -2490,9 +2704,34 @@ MeshMatrix<type> convection(MeshField<type,CELL>& cF,const VectorCellField& Fc,
     addTemporal<1>(M,cF_UR,rho);
     return M;
 }
+/**
+Convective residual of an IMEX step. The state is extrapolated from the
+stored history with the order of the BDF scheme, and the convection
+operator is applied to it explicitly.
+*/
+template<class type>
+MeshField<type,CELL> imexConvection(MeshField<type,CELL>& cF,const VectorCellField& Fc,
+        const ScalarFacetField& F,const ScalarCellField& mu) {
+    using namespace Controls;
+    MeshMatrix<type> Mc = div(cF,Fc,F,&mu);
+    Int k = time_scheme - BDF1 + 1;
+    Scalar c = Scalar(k);
+    MeshField<type,CELL> cE = cF.tprev(0) * c;
+    for(Int j = 1;j < k;j++) {
+        c *= -Scalar(k - j) / (j + 1);
+        cE += cF.tprev(j) * c;
+    }
+    return mul(Mc,cE) - Mc.Su;
+}
 template<class type>
 MeshMatrix<type> transport(MeshField<type,CELL>& cF,const VectorCellField& Fc,const ScalarFacetField& F,
         const ScalarCellField& mu, Scalar cF_UR, ScalarCellField* rho = 0) {
+    if(Controls::imex && Controls::state != Controls::STEADY) {
+        MeshMatrix<type> M = -lap(cF,mu);
+        addTemporal<1>(M,cF_UR,rho);
+        M.Su -= imexConvection(cF,Fc,F,mu);
+        return M;
+    }
     MeshMatrix<type> M = div(cF,Fc,F,&mu) - lap(cF,mu);
     addTemporal<1>(M,cF_UR,rho);
     return M;
@@ -2501,10 +2740,471 @@ template<class type>
 MeshMatrix<type> transport(MeshField<type,CELL>& cF,const VectorCellField& Fc,const ScalarFacetField& F,
         const ScalarCellField& mu, Scalar cF_UR, 
         const MeshField<type,CELL>& Su,const ScalarCellField& Sp, ScalarCellField* rho = 0) {
+    if(Controls::imex && Controls::state != Controls::STEADY) {
+        MeshMatrix<type> M = -lap(cF,mu) - src(cF,Su,Sp);
+        addTemporal<1>(M,cF_UR,rho);
+        M.Su -= imexConvection(cF,Fc,F,mu);
+        return M;
+    }
     MeshMatrix<type> M = div(cF,Fc,F,&mu) - lap(cF,mu) - src(cF,Su,Sp);
     addTemporal<1>(M,cF_UR,rho);
     return M;
 }
+/* ************************************************
+ * Matrix-free explicit time integration
+ *************************************************/
+
+/** Add DG volume terms of convection and diffusion of element ci scaled by w */
+template<class type>
+void addVolumeTerms(MeshField<type,CELL>& r,const MeshField<type,CELL>& cF,
+        const VectorCellField* Fc,const ScalarCellField* muc,Int ci,Scalar w = 1) {
+    using namespace Mesh;
+    using namespace DG;
+    static std::vector<Vector> dr, dp;
+    static IntVector nd;
+    dr.resize(NPI);
+    dp.resize(NPI);
+    nd.resize(NPI);
+    JACOBIAN(ci);
+    forEachLgl(ii,jj,kk) {
+        Int index = INDEX4(ci,ii,jj,kk);
+        Tensor Jin = JINV(ii,jj,kk);
+        Int n = 0;
+#define LINE(im,jm,km) {                                    \
+    Vector dpsi_ij;                                         \
+    DPSI(dpsi_ij,im,jm,km);                                 \
+    dr[n] = dpsi_ij;                                        \
+    dp[n] = dot(Jin,dpsi_ij);                               \
+    nd[n++] = INDEX4(ci,im,jm,km);                          \
+}
+        forEachLglX(i) LINE(i,jj,kk);
+        forEachLglY(j) if(j != jj) LINE(ii,j,kk);
+        forEachLglZ(k) if(k != kk) LINE(ii,jj,k);
+#undef LINE
+        /*convection*/
+        if(Fc) {
+            Vector Jr = dot(Jin,(*Fc)[index]) * (cV[index] * w);
+            for(Int p = 0;p < n;p++)
+                r[nd[p]] += cF[index] * dot(Jr,dr[p]);
+        }
+        /*diffusion*/
+        if(muc) {
+            Scalar cw = cV[index] * (*muc)[index] * w;
+            for(Int p = 0;p < n;p++) {
+                type v = type(Scalar(0));
+                for(Int q = 0;q < n;q++)
+                    v += cF[nd[q]] * dot(dp[p],dp[q]);
+                r[nd[p]] -= v * cw;
+            }
+        }
+    }
+}
+
+/**
+Explicit residual of a transport equation evaluated directly from
+fluxes and volume terms, without assembling a matrix,
+     R = -div(cF,F) + lap(cF,mu) + S
+The convective term is skipped when no flux is given.
+*/
+template<class type>
+MeshField<type,CELL> transportf(const MeshField<type,CELL>& cF,
+        const VectorCellField* Fc,const ScalarFacetField* F,
+        const ScalarCellField* muc = 0,const MeshField<type,CELL>* S = 0) {
+    using namespace Controls;
+    using namespace Mesh;
+    using namespace DG;
+    MeshField<type,CELL> r;
+    r = type(Scalar(0));
+
+    /*convection*/
+    if(F) {
+        const ScalarFacetField& flux = *F;
+        MeshField<type,FACET> fF;
+        bool isImplicit = (
+            convection_scheme == CDS ||
+            convection_scheme == UDS ||
+            convection_scheme == BLENDED ||
+            convection_scheme == HYBRID );
+        if(isImplicit) {
+            ScalarFacetField gamma = blendFactor(flux,muc);
+            MeshField<type,FACET> fc = cds(cF), fu = uds(cF,flux);
+            forEach(fF,i)
+                fF[i] = fc[i] * gamma[i] + fu[i] * (1 - gamma[i]);
+        } else {
+            fF = uds(cF,flux) + deferredCorrection(cF,flux);
+        }
+        forEach(flux,i) {
+            type v = fF[i] * flux[i];
+            r[FO[i]] -= v;
+            r[FN[i]] += v;
+        }
+    }
+    
+    /*diffusion*/
+    if(muc) {
+        const ScalarCellField& mu = *muc;
+        ScalarFacetField muf = cds(mu);
+        forEach(fN,i) {
+            Int c1 = FO[i];
+            Int c2 = FN[i];
+            Scalar a = NPMAT ? muf[i] : fD[i] * muf[i];
+            type v = (cF[c2] - cF[c1]) * a;
+            r[c1] += v;
+            r[c2] -= v;
+        }
+        if(NPMAT) {
+            r += sum(dot(cds(mu * gradi(cF)),fN));
+        } else if(nonortho_scheme != NONE) {
+            VectorFacetField K;
+            forEach(fN,i) {
+                Vector dv = cC[FN[i]] - cC[FO[i]];
+                K[i] = fN[i] - fD[i] * dv;
+            }
+            MeshField<type,FACET> q = dot(cds(mu * gradi(cF)),K);
+            forEach(q,i) {
+                type res = (cF[FN[i]] - cF[FO[i]]) * (fD[i] * muf[i]);
+                if(mag(q[i]) > Scalar(0.5) * mag(res))
+                    q[i] = Scalar(0.5) * res;
+            }
+            r += sum(q);
+        }
+    }
+    
+    /*DG volume terms*/
+    if(NPMAT && (F || muc)) {
+        for(Int ci = 0; ci < gBCS;ci++)
+            addVolumeTerms(r,cF,(F ? Fc : 0),muc,ci);
+    }
+    
+    /*explicit source*/
+    if(S) r += *S;
+    
+    return r;
+}
+
+/** Locally stable explicit time step of each cell at unit CFL number */
+inline void localDt(ScalarCellField& ldt,const ScalarFacetField* F,
+                    const ScalarCellField* muc = 0,const ScalarCellField* rho = 0) {
+    using namespace Mesh;
+    using namespace DG;
+    ScalarCellField s;
+    ScalarFacetField muf;
+    s = Scalar(0);
+    if(muc) muf = cds(*muc);
+    forEach(fN,i) {
+        Scalar v = 0;
+        if(F) v += fabs((*F)[i]) / 2;
+        if(muc) v += NPMAT ? muf[i] : muf[i] * fD[i];
+        s[FO[i]] += v;
+        s[FN[i]] += v;
+    }
+    /*row sums of DG volume diffusion*/
+    if(NPMAT && muc) {
+        std::vector<Vector> dp(NPI);
+        IntVector nd(NPI);
+        for(Int ci = 0;ci < gBCS;ci++) {
+            JACOBIAN(ci);
+            forEachLgl(ii,jj,kk) {
+                Int index = INDEX4(ci,ii,jj,kk);
+                Tensor Jin = JINV(ii,jj,kk);
+                Int n = 0;
+#define LINE(im,jm,km) {                                    \
+    Vector dpsi_ij;                                         \
+    DPSI(dpsi_ij,im,jm,km);                                 \
+    dp[n] = dot(Jin,dpsi_ij);                               \
+    nd[n++] = INDEX4(ci,im,jm,km);                          \
+}
+                forEachLglX(i) LINE(i,jj,kk);
+                forEachLglY(j) if(j != jj) LINE(ii,j,kk);
+                forEachLglZ(k) if(k != kk) LINE(ii,jj,k);
+#undef LINE
+                Scalar cw = cV[index] * (*muc)[index];
+                for(Int p = 0;p < n;p++) {
+                    for(Int q = 0;q < n;q++)
+                        s[nd[p]] += cw * fabs(dot(dp[p],dp[q]));
+                }
+            }
+        }
+    }
+    Int p = std::max(Nop[0],std::max(Nop[1],Nop[2]));
+    ldt = Scalar(1e30);
+    for(Int i = 0;i < gBCSfield;i++) {
+        Scalar m = cV[i] * (rho ? (*rho)[i] : Scalar(1)) / (2 * p + 1);
+        if(s[i] > 0 && m < ldt[i] * s[i])
+            ldt[i] = m / s[i];
+    }
+}
+
+/** Stable explicit time step of a transport equation at the given CFL number */
+inline Scalar explicitDt(const ScalarFacetField* F,const ScalarCellField* muc = 0,
+                         const ScalarCellField* rho = 0) {
+    using namespace Mesh;
+    ScalarCellField ldt;
+    localDt(ldt,F,muc,rho);
+    Scalar dt = Scalar(1e30), gdt;
+    for(Int i = 0;i < gBCSfield;i++)
+        dt = std::min(dt,ldt[i]);
+    MP::allreduce(&dt,&gdt,1,MP::OP_MIN);
+    return Controls::CFL * gdt;
+}
+
+/**
+Group cells into multirate levels by their stable time step. The
+smallest step h is CFL times the smallest stable step, or with CFL <= 0
+the given Controls::dt divided by 2^(lts_levels - 1). A cell is put on
+the highest level l < lts_levels whose step h*2^l is stable for it, the
+levels of neighbours differ by at most one, and DG nodes take the level
+of their element. With CFL > 0, Controls::dt is set to the step of the
+coarsest level. The smallest step h is returned.
+*/
+inline Scalar explicitLevels(ScalarCellField& level,const ScalarFacetField* F,
+                             const ScalarCellField* muc = 0,const ScalarCellField* rho = 0) {
+    using namespace Controls;
+    using namespace Mesh;
+    using namespace DG;
+    ScalarCellField ldt;
+    localDt(ldt,F,muc,rho);
+    
+    /*smallest step of each element*/
+    if(NPMAT) {
+        for(Int ci = 0;ci < gBCS;ci++) {
+            Scalar m = ldt[ci * NP];
+            for(Int j = 1;j < NP;j++)
+                m = std::min(m,ldt[ci * NP + j]);
+            for(Int j = 0;j < NP;j++)
+                ldt[ci * NP + j] = m;
+        }
+    }
+    Scalar h, c = (CFL > 0) ? CFL : Scalar(1);
+    if(CFL > 0) {
+        Scalar m = Scalar(1e30);
+        for(Int i = 0;i < gBCSfield;i++)
+            m = std::min(m,ldt[i]);
+        MP::allreduce(&m,&h,1,MP::OP_MIN);
+        h *= CFL;
+    } else {
+        h = dt / (1 << (lts_levels - 1));
+    }
+    
+    /*levels, boundary ghosts never restrict a neighbour*/
+    level = Scalar(lts_levels);
+    for(Int i = 0;i < gBCSfield;i++) {
+        Int l = 0;
+        while(l + 1 < lts_levels && h * (1 << (l + 1)) <= c * ldt[i])
+            l++;
+        level[i] = l;
+    }
+    for(Int iter = 0;iter < lts_levels;iter++) {
+        applyExplicitBCs(level,true,false);
+        forEach(fN,i) {
+            Int c1 = FO[i];
+            Int c2 = FN[i];
+            if(level[c1] > level[c2] + 1) level[c1] = level[c2] + 1;
+            if(c2 < gBCSfield && level[c2] > level[c1] + 1) level[c2] = level[c1] + 1;
+        }
+        if(NPMAT) {
+            for(Int ci = 0;ci < gBCS;ci++) {
+                Scalar m = level[ci * NP];
+                for(Int j = 1;j < NP;j++)
+                    m = std::min(m,level[ci * NP + j]);
+                for(Int j = 0;j < NP;j++)
+                    level[ci * NP + j] = m;
+            }
+        }
+    }
+    applyExplicitBCs(level,true,false);
+    
+    /*step of coarsest level*/
+    if(CFL > 0) {
+        Scalar lmax = 0, glmax;
+        for(Int i = 0;i < gBCSfield;i++)
+            lmax = std::max(lmax,level[i]);
+        MP::allreduce(&lmax,&glmax,1,MP::OP_MAX);
+        dt = h * (1 << Int(glmax));
+    }
+    return h;
+}
+
+/**
+Set the explicit time step from the CFL number. With multirate
+stepping the levels are filled in and the smallest step is returned,
+otherwise zero is returned.
+*/
+inline Scalar explicitTimeStep(ScalarCellField& level,const ScalarFacetField* F,
+                               const ScalarCellField* muc = 0,const ScalarCellField* rho = 0) {
+    if(Controls::lts_levels > 1) 
+        return explicitLevels(level,F,muc,rho);
+    if(Controls::CFL > 0)
+        Controls::dt = explicitDt(F,muc,rho);
+    return 0;
+}
+
+/**
+First-order face fluxes and DG volume terms of the levels that are
+active at substep k of a multirate step, integrated over their step h*2^l.
+All terms are added with unit weight when h is zero.
+*/
+template<class type>
+void multirateResidual(MeshField<type,CELL>& r,const MeshField<type,CELL>& cF,
+        const VectorCellField* Fc,const ScalarFacetField* F,const ScalarCellField* muc,
+        const ScalarFacetField& gamma,const ScalarFacetField& a,
+        const ScalarCellField& level,Int k,Scalar h) {
+    using namespace Mesh;
+    using namespace DG;
+    forEach(fN,i) {
+        Int c1 = FO[i];
+        Int c2 = FN[i];
+        Int p = 1 << Int(std::min(level[c1],level[c2]));
+        Scalar w = 1;
+        if(h > 0) {
+            if(k % p) continue;
+            w = h * p;
+        }
+        type v = (cF[c1] - cF[c2]) * a[i];
+        if(F) {
+            Scalar f = (*F)[i];
+            type fc = cF[c1] * fI[i] + cF[c2] * (1 - fI[i]);
+            type fu = (f >= 0) ? cF[c1] : cF[c2];
+            v += (fc * gamma[i] + fu * (1 - gamma[i])) * f;
+        }
+        v = v * w;
+        r[c1] -= v;
+        r[c2] += v;
+    }
+    if(NPMAT && (F || muc)) {
+        for(Int ci = 0;ci < gBCS;ci++) {
+            Int p = 1 << Int(level[ci * NP]);
+            Scalar w = 1;
+            if(h > 0) {
+                if(k % p) continue;
+                w = h * p;
+            }
+            addVolumeTerms(r,cF,(F ? Fc : 0),muc,ci,w);
+        }
+    }
+}
+
+/**
+Multirate explicit step over Controls::dt. Cells of level l take steps
+of h*2^l. Face fluxes are evaluated at the rate of the finer side and
+accumulated on both sides, so the step is conservative. The remaining
+high-order, non-orthogonal and source terms are evaluated once per step.
+*/
+template<class type>
+void multirateTransport(MeshField<type,CELL>& cF,const VectorCellField* Fc,
+        const ScalarFacetField* F,const ScalarCellField* muc,
+        const MeshField<type,CELL>* S,const ScalarCellField* rho,
+        const ScalarCellField& level,Scalar h) {
+    using namespace Controls;
+    using namespace Mesh;
+    using namespace DG;
+    Int nsub = Int(dt / h + Scalar(0.5));
+    
+    /*face coefficients*/
+    ScalarFacetField gamma, a;
+    bool isImplicit = (
+        convection_scheme == CDS ||
+        convection_scheme == UDS ||
+        convection_scheme == BLENDED ||
+        convection_scheme == HYBRID );
+    if(F && isImplicit) gamma = blendFactor(*F,muc);
+    else gamma = Scalar(0);
+    if(muc) {
+        a = cds(*muc);
+        if(!NPMAT) forEach(a,i) a[i] *= fD[i];
+    } else 
+        a = Scalar(0);
+    
+    /*terms held over the step*/
+    ScalarCellField im;
+    MeshField<type,CELL> lag, acc;
+    if(rho) im = Scalar(1) / (cV * (*rho));
+    else im = Scalar(1) / cV;
+    lag = transportf(cF,Fc,F,muc,S);
+    if(rho && F) lag += cF * sum(*F);
+    acc = type(Scalar(0));
+    multirateResidual(acc,cF,Fc,F,muc,gamma,a,level,0,Scalar(0));
+    lag -= acc;
+    
+    /*substeps*/
+    acc = type(Scalar(0));
+    for(Int k = 0;k < nsub;k++) {
+        multirateResidual(acc,cF,Fc,F,muc,gamma,a,level,k,h);
+        for(Int i = 0;i < gBCSfield;i++) {
+            Int p = 1 << Int(level[i]);
+            if(k % p == 0) 
+                acc[i] += lag[i] * (h * p);
+            if((k + 1) % p == 0) {
+                cF[i] += acc[i] * im[i];
+                acc[i] = type(Scalar(0));
+            }
+        }
+        applyExplicitBCs(cF,true,false);
+    }
+}
+
+/**
+Matrix-free explicit Runge-Kutta step of
+     rho * V * dcF/dt = transportf(cF)
+The runge_kutta control selects forward Euler (1), SSP-RK2 (2),
+SSP-RK3 (3) or the five-stage low-storage RK4 of Carpenter and
+Kennedy (4). The mass matrix is the diagonal of node volumes.
+Density is held fixed over the step, so the convective form
+rho * (dcF/dt + U.grad(cF)) is used when rho is given. Given
+time-step levels and a smallest step h, a multirate step is taken.
+*/
+template<class type>
+void explicitTransport(MeshField<type,CELL>& cF,const VectorCellField* Fc,
+        const ScalarFacetField* F,const ScalarCellField* muc = 0,
+        const MeshField<type,CELL>* S = 0,const ScalarCellField* rho = 0,
+        const ScalarCellField* level = 0,Scalar h = 0) {
+    using namespace Controls;
+    if(level && h > 0) {
+        multirateTransport(cF,Fc,F,muc,S,rho,*level,h);
+        return;
+    }
+    ScalarCellField idt, divF;
+    if(rho) idt = dt / (Mesh::cV * (*rho));
+    else idt = dt / Mesh::cV;
+    if(rho && F) divF = sum(*F);
+    else divF = Scalar(0);
+#define RHS() ((transportf(cF,Fc,F,muc,S) + cF * divF) * idt)
+    if(runge_kutta >= 4) {
+        static const Scalar A[5] = {
+            0.0,
+            -567301805773.0 / 1357537059087.0,
+            -2404267990393.0 / 2016746695238.0,
+            -3550918686646.0 / 2091501179385.0,
+            -1275806237668.0 / 842570457699.0 };
+        static const Scalar B[5] = {
+            1432997174477.0 / 9575080441755.0,
+            5161836677717.0 / 13612068292357.0,
+            1720146321549.0 / 2090206949498.0,
+            3134564353537.0 / 4481467310338.0,
+            2277821191437.0 / 14882151754819.0 };
+        MeshField<type,CELL> dU;
+        dU = type(Scalar(0));
+        for(Int s = 0;s < 5;s++) {
+            dU = dU * A[s] + RHS();
+            cF += dU * B[s];
+            applyExplicitBCs(cF,true,false);
+        }
+    } else {
+        MeshField<type,CELL> u0 = cF;
+        cF += RHS();
+        applyExplicitBCs(cF,true,false);
+        if(runge_kutta == 2) {
+            cF = (u0 + cF + RHS()) / 2;
+            applyExplicitBCs(cF,true,false);
+        } else if(runge_kutta == 3) {
+            cF = (3 * u0 + cF + RHS()) / 4;
+            applyExplicitBCs(cF,true,false);
+            cF = (u0 + 2 * (cF + RHS())) / 3;
+            applyExplicitBCs(cF,true,false);
+        }
+    }
+#undef RHS
+}
 /* ********************
  *        End
  * ********************/
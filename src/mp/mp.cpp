@@ -12,12 +12,13 @@ int  MP::_start_time = 0;
 bool MP::Terminated = false;
 bool MP::printOn = true;
 char MP::workingDir[PATH_MAX + 1];
+MPI_Comm MP::comm = MPI_COMM_WORLD;
 
 /** Initialize MPI */
 MP::MP(int argc,char* argv[]) {
     MPI_Init(&argc, &argv);
-    MPI_Comm_size(MPI_COMM_WORLD, &n_hosts);
-    MPI_Comm_rank(MPI_COMM_WORLD, &host_id);
+    MPI_Comm_size(comm, &n_hosts);
+    MPI_Comm_rank(comm, &host_id);
     MPI_Get_processor_name(host_name, &name_len);
     _start_time = System::get_time();
     System::pwd(workingDir,PATH_MAX + 1);
@@ -36,24 +37,39 @@ MP::~MP() {
 
 /** Synchronous seend */
 void MP::send(int source,int message_id) {
-    MPI_Send(MPI_BOTTOM,0,MPI_INT,source,message_id,MPI_COMM_WORLD);
+    MPI_Send(MPI_BOTTOM,0,MPI_INT,source,message_id,comm);
 }
 
 /** Synchronous recieve */
 void MP::recieve(int source,int message_id) {
-    MPI_Recv(MPI_BOTTOM,0,MPI_INT,source,message_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+    MPI_Recv(MPI_BOTTOM,0,MPI_INT,source,message_id,comm,MPI_STATUS_IGNORE);
 }
 
 /** Barrier */
 void MP::barrier() {
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(comm);
+}
+
+/** Split processes into independent groups of the same color */
+void MP::split(int color) {
+    MPI_Comm_split(MPI_COMM_WORLD, color, host_id, &comm);
+    MPI_Comm_size(comm, &n_hosts);
+    MPI_Comm_rank(comm, &host_id);
+}
+
+/** Join groups of processes back together */
+void MP::join() {
+    MPI_Comm_free(&comm);
+    comm = MPI_COMM_WORLD;
+    MPI_Comm_size(comm, &n_hosts);
+    MPI_Comm_rank(comm, &host_id);
 }
 
 /** Asynchronous probe for messages */
 int MP::iprobe(int& source,int& message_id,int tag) {
     int flag;
     MPI_Status mpi_status;
-    MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD,&flag,&mpi_status);
+    MPI_Iprobe(MPI_ANY_SOURCE, tag, comm,&flag,&mpi_status);
     if(flag) {
         message_id = mpi_status.MPI_TAG;
         source = mpi_status.MPI_SOURCE;
@@ -34,6 +34,7 @@ public:
     typedef MPI_Request REQUEST;
 
     static int n_hosts,host_id,name_len;
+    static MPI_Comm comm;
     static char host_name[PATH_MAX + 1];
     static int _start_time;
     static bool Terminated;
@@ -42,6 +43,8 @@ public:
     static void cleanup();
     static void loop();
     static void barrier();
+    static void split(int);
+    static void join();
     static int iprobe(int&,int&,int);
     static void send(int,int);
     static void recieve(int,int);
@@ -52,12 +55,12 @@ public:
     template <class type>
     static void recieve(type* buffer,int size,int source,int message_id) {
         const int count = (size * sizeof(type) / sizeof(MPI_SCALAR));
-        MPI_Recv(buffer,count,MPI_SCALAR,source,message_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+        MPI_Recv(buffer,count,MPI_SCALAR,source,message_id,comm,MPI_STATUS_IGNORE);
     }
     template <class type>
     static void send(type* buffer,int size,int source,int message_id) {
         const int count = (size * sizeof(type) / sizeof(MPI_SCALAR));
-        MPI_Send(buffer,count,MPI_SCALAR,source,message_id,MPI_COMM_WORLD);
+        MPI_Send(buffer,count,MPI_SCALAR,source,message_id,comm);
     }
     template <class type>
     static void allreduce(type* sendbuf,type* recvbuf,int size, Int op) {
@@ -69,17 +72,17 @@ public:
             case OP_SUM: mpi_op = MPI_SUM; break;
             case OP_PROD: mpi_op = MPI_PROD; break;
         }
-        MPI_Allreduce(sendbuf,recvbuf,count,MPI_SCALAR,mpi_op,MPI_COMM_WORLD);
+        MPI_Allreduce(sendbuf,recvbuf,count,MPI_SCALAR,mpi_op,comm);
     }
     template <class type>
     static void irecieve(type* buffer,int size,int source,int message_id,void* request) {
         const int count = (size * sizeof(type) / sizeof(MPI_SCALAR));
-        MPI_Irecv(buffer,count,MPI_SCALAR,source,message_id,MPI_COMM_WORLD,(MPI_Request*)request);
+        MPI_Irecv(buffer,count,MPI_SCALAR,source,message_id,comm,(MPI_Request*)request);
     }
     template <class type>
     static void isend(type* buffer,int size,int source,int message_id,void* request) {
         const int count = (size * sizeof(type) / sizeof(MPI_SCALAR));
-        MPI_Isend(buffer,count,MPI_SCALAR,source,message_id,MPI_COMM_WORLD,(MPI_Request*)request);
+        MPI_Isend(buffer,count,MPI_SCALAR,source,message_id,comm,(MPI_Request*)request);
     }
     static void waitall(int count,void* request) {
         MPI_Waitall(count,(MPI_Request*)request,MPI_STATUS_IGNORE);
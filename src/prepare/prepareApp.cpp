@@ -11,6 +11,7 @@ Post/Pre processing jobs such as
   Merging results of decomposed domains
   Converting data to VTK format
   Probing result at specified locations
+  Mapping fields from another mesh
 \endverbatim
 */
 int main(int argc,char* argv[]) {
@@ -20,6 +21,7 @@ int main(int argc,char* argv[]) {
     /*cmd line*/
     int work = 0;
     Int start_index = 0;
+    string source;
     for(int i = 1;i < argc;i++) {
         if(!strcmp(argv[i],"-merge")) {
             work = 1;
@@ -29,6 +31,14 @@ int main(int argc,char* argv[]) {
             work = 3;
         } else if(!strcmp(argv[i],"-refine")) {
             work = 4;
+        } else if(!strcmp(argv[i],"-map")) {
+            if(i + 1 >= argc) {
+                std::cout << "-map requires a source directory.\n";
+                return 1;
+            }
+            work = 5;
+            i++;
+            source = argv[i];
         } else if(!strcmp(argv[i],"-poly")) {
             Vtk::write_polyhedral = true;
         } else if(!strcmp(argv[i],"-start")) {
@@ -42,6 +52,7 @@ int main(int argc,char* argv[]) {
                       << "  -vtk        --  Convert data to VTK format\n"
                       << "  -probe      --  Probe result at specified locations\n"
                       << "  -refine     --  Refine mesh\n"
+                      << "  -map <dir>  --  Map fields from mesh in <dir>\n"
                       << "  -poly       --  Write VTK in polyhedral format\n"
                       << "  -start <i>  --  Start at time step <i>\n"
                       << "  -h          --  Display this message\n\n";
@@ -106,6 +117,9 @@ int main(int argc,char* argv[]) {
     } else if(work == 4) {
         cout << "Refining grid.\n";
         Prepare::refineMesh(start_index);
+    } else if(work == 5) {
+        cout << "Mapping fields.\n";
+        Prepare::mapFields(source,start_index);
     } else {
         cout << "Decomposing domain.\n";
         Prepare::decomposeMesh(start_index);
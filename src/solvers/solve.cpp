@@ -4,6 +4,17 @@
  *  Solve system of linear equations iteratively
  * *********************************************************************/
 
+/**
+Outer residuals
+*/
+namespace Residuals {
+    ResidualMap outer;
+    void record(const std::string& name,Scalar res) {
+        Scalar& r = outer[name];
+        if(res > r) r = res;
+    }
+}
+
 /**
 Calculate global residual
 */
@@ -27,6 +38,686 @@ Scalar getResidual(const MeshField<type,entity>& r,
     return sqrt(sdiv(mag(res[0]), mag(res[1])));
 }
 /**
+Calculate global mean of the internal cell values
+*/
+template<class type>
+type getMean(const MeshField<type,CELL>& cF,bool sync) {
+    type sum = type(0);
+    Scalar count = Mesh::gBCSfield;
+    for(Int i = 0;i < Mesh::gBCSfield;i++)
+        sum += cF[i];
+    if(sync) {
+        type global_sum;
+        Scalar global_count;
+        MP::allreduce(&sum,&global_sum,1,MP::OP_SUM);
+        MP::allreduce(&count,&global_count,1,MP::OP_SUM);
+        sum = global_sum;
+        count = global_count;
+    }
+    return sum / count;
+}
+/**
+Check if all rows of the matrix sum to zero so that a constant field
+lies in its null space, e.g. pressure with only NEUMANN/SYMMETRY BCs
+*/
+template<class T1, class T2, class T3>
+bool isSingular(const MeshMatrix<T1,T2,T3>& M,bool sync) {
+    using namespace Mesh;
+    if(DG::NPMAT) 
+        return false;
+    MeshField<T2,CELL> rsum = M.ap;
+    forEach(fN,k) {
+        rsum[FO[k]] -= M.an[1][k];
+        rsum[FN[k]] -= M.an[0][k];
+    }
+    Scalar rmax = 0;
+    for(Int i = 0;i < gBCSfield;i++) {
+        Scalar v = sdiv(mag(rsum[i]),mag(M.ap[i]));
+        if(v > rmax) rmax = v;
+    }
+    if(sync) {
+        Scalar global_rmax;
+        MP::allreduce(&rmax,&global_rmax,1,MP::OP_MAX);
+        rmax = global_rmax;
+    }
+    return (rmax < 1e-8);
+}
+/**
+LU factorization of a dense N x N block with partial pivoting
+*/
+inline void luFactor(Scalar* a,Int* p,Int N) {
+    for(Int k = 0;k < N;k++) {
+        Int m = k;
+        for(Int i = k + 1;i < N;i++) {
+            if(fabs(a[i * N + k]) > fabs(a[m * N + k]))
+                m = i;
+        }
+        p[k] = m;
+        if(m != k) {
+            for(Int j = 0;j < N;j++)
+                std::swap(a[k * N + j],a[m * N + j]);
+        }
+        Scalar d = 1 / a[k * N + k];
+        for(Int i = k + 1;i < N;i++) {
+            Scalar f = (a[i * N + k] *= d);
+            for(Int j = k + 1;j < N;j++)
+                a[i * N + j] -= f * a[k * N + j];
+        }
+    }
+}
+/**
+Solve with an LU factorized block or its transpose
+*/
+template<class T>
+void luSolve(const Scalar* a,const Int* p,Int N,T* x,bool tr) {
+    if(!tr) {
+        for(Int k = 0;k < N;k++)
+            if(p[k] != k) std::swap(x[k],x[p[k]]);
+        for(Int i = 1;i < N;i++)
+            for(Int j = 0;j < i;j++)
+                x[i] -= x[j] * a[i * N + j];
+        for(Int i = N;i-- > 0;) {
+            for(Int j = i + 1;j < N;j++)
+                x[i] -= x[j] * a[i * N + j];
+            x[i] *= (1 / a[i * N + i]);
+        }
+    } else {
+        for(Int i = 0;i < N;i++) {
+            for(Int j = 0;j < i;j++)
+                x[i] -= x[j] * a[j * N + i];
+            x[i] *= (1 / a[i * N + i]);
+        }
+        for(Int i = N;i-- > 0;)
+            for(Int j = i + 1;j < N;j++)
+                x[i] -= x[j] * a[j * N + i];
+        for(Int k = N;k-- > 0;)
+            if(p[k] != k) std::swap(x[k],x[p[k]]);
+    }
+}
+/**
+Geometric multigrid preconditioner. For DG systems the polynomial
+order is first halved level by level down to p = 0 using interpolation
+between LGL nodes (p-multigrid), after which coarse levels are built by
+agglomerating face neighbours of the processor's cells. Coarse operators
+are formed by Galerkin projection. Couplings across processor boundaries
+are ignored.
+*/
+template<class T3>
+class Multigrid {
+    /** Multigrid level */
+    struct Level {
+        Int n;                  /**< Number of unknowns */
+        Int bs;                 /**< Unknowns per element block */
+        IntVector start,col;    /**< Off-diagonal entries in row order */
+        ScalarVector val;       /**< Off-diagonal coefficients */
+        ScalarVector ap,iap;    /**< Diagonal and its inverse */
+        IntVector pstart,pcol;  /**< Prolongation from next level */
+        ScalarVector pval;      /**< Prolongation weights */
+        ScalarVector lu;        /**< Factorized element blocks */
+        IntVector piv;          /**< Pivots of element blocks */
+        std::vector<T3> x,b;    /**< Solution and right hand side */
+    };
+    std::vector<Level> levels;
+    std::vector<T3> s;
+
+    /** Aggregate each cell with its unaggregated neighbours */
+    Int agglomerate(Level& L) {
+        const Int none = Int(-1);
+        Int nc = 0;
+        IntVector agg(L.n,none);
+        /*seeds with all neighbours free*/
+        for(Int i = 0;i < L.n;i++) {
+            if(agg[i] != none) continue;
+            bool isfree = true;
+            for(Int k = L.start[i];k < L.start[i + 1];k++) {
+                if(agg[L.col[k]] != none) {
+                    isfree = false;
+                    break;
+                }
+            }
+            if(!isfree) continue;
+            agg[i] = nc;
+            for(Int k = L.start[i];k < L.start[i + 1];k++)
+                agg[L.col[k]] = nc;
+            nc++;
+        }
+        /*attach leftover cells to the strongest neighbour*/
+        for(Int i = 0;i < L.n;i++) {
+            if(agg[i] != none) continue;
+            Scalar strong = 0;
+            for(Int k = L.start[i];k < L.start[i + 1];k++) {
+                Int j = L.col[k];
+                if(agg[j] != none && agg[j] < nc
+                    && fabs(L.val[k]) >= strong) {
+                    strong = fabs(L.val[k]);
+                    agg[i] = agg[j];
+                }
+            }
+            if(agg[i] == none)
+                agg[i] = nc++;
+        }
+        /*piecewise constant prolongation*/
+        L.pstart.resize(L.n + 1);
+        L.pval.assign(L.n,1);
+        for(Int i = 0;i <= L.n;i++)
+            L.pstart[i] = i;
+        L.pcol.swap(agg);
+        return nc;
+    }
+    /** Interpolation between LGL nodes of order pc and pf */
+    static void interpolate(Int pf,Int pc,ScalarVector& P) {
+        ScalarVector xf(pf + 1),xc(pc + 1),w(std::max(pf,pc) + 1);
+        DG::legendre_gauss_lobatto(pf + 1,&xf[0],&w[0]);
+        DG::legendre_gauss_lobatto(pc + 1,&xc[0],&w[0]);
+        P.assign((pf + 1) * (pc + 1),1);
+        for(Int i = 0;i <= pf;i++) {
+            for(Int a = 0;a <= pc;a++) {
+                Scalar& l = P[i * (pc + 1) + a];
+                for(Int m = 0;m <= pc;m++) {
+                    if(m != a)
+                        l *= (xf[i] - xc[m]) / (xc[a] - xc[m]);
+                }
+            }
+        }
+    }
+    /** Prolongation from order pc to pf on each element */
+    Int lower_order(Level& L,const Int* pf,const Int* pc) {
+        using namespace Mesh;
+        ScalarVector P[3];
+        for(Int d = 0;d < 3;d++)
+            interpolate(pf[d],pc[d],P[d]);
+        const Int nc = (pc[0] + 1) * (pc[1] + 1) * (pc[2] + 1);
+        L.pstart.assign(1,0);
+        L.pcol.clear();
+        L.pval.clear();
+        for(Int e = 0;e < gBCS;e++) {
+            for(Int i = 0;i <= pf[0];i++)
+            for(Int j = 0;j <= pf[1];j++)
+            for(Int k = 0;k <= pf[2];k++) {
+                for(Int a = 0;a <= pc[0];a++)
+                for(Int b = 0;b <= pc[1];b++)
+                for(Int c = 0;c <= pc[2];c++) {
+                    Scalar w = P[0][i * (pc[0] + 1) + a] *
+                               P[1][j * (pc[1] + 1) + b] *
+                               P[2][k * (pc[2] + 1) + c];
+                    if(fabs(w) < 1e-12) continue;
+                    L.pcol.push_back(e * nc + 
+                        (a * (pc[1] + 1) + b) * (pc[2] + 1) + c);
+                    L.pval.push_back(w);
+                }
+                L.pstart.push_back(L.pcol.size());
+            }
+        }
+        return gBCS * nc;
+    }
+    /** Galerkin coarse operator P^T A P */
+    void coarsen(Level& L,Level& C) {
+        C.ap.assign(C.n,0);
+        C.start.assign(C.n + 1,0);
+        C.col.clear();
+        C.val.clear();
+        /*fine rows contributing to each coarse row*/
+        IntVector first(C.n + 1,0),rows(L.pcol.size());
+        ScalarVector wts(L.pcol.size());
+        for(Int k = 0;k < L.pcol.size();k++)
+            first[L.pcol[k] + 1]++;
+        for(Int c = 0;c < C.n;c++)
+            first[c + 1] += first[c];
+        IntVector pos(first.begin(),first.end() - 1);
+        for(Int i = 0;i < L.n;i++) {
+            for(Int k = L.pstart[i];k < L.pstart[i + 1];k++) {
+                Int m = pos[L.pcol[k]]++;
+                rows[m] = i;
+                wts[m] = L.pval[k];
+            }
+        }
+        /*sum weighted fine rows*/
+        const Int none = Int(-1);
+        pos.assign(C.n,none);
+        ScalarVector acc(C.n,0);
+        IntVector cols;
+#define MG_ADD(j_,a_) {                                     \
+    for(Int q = L.pstart[j_];q < L.pstart[(j_) + 1];q++) {  \
+        Int d = L.pcol[q];                                  \
+        if(pos[d] == none) {                                \
+            pos[d] = cols.size();                           \
+            cols.push_back(d);                              \
+        }                                                   \
+        acc[d] += w * (a_) * L.pval[q];                     \
+    }                                                       \
+}
+        for(Int c = 0;c < C.n;c++) {
+            cols.clear();
+            for(Int m = first[c];m < first[c + 1];m++) {
+                Int i = rows[m];
+                Scalar w = wts[m];
+                MG_ADD(i,L.ap[i]);
+                for(Int k = L.start[i];k < L.start[i + 1];k++)
+                    MG_ADD(L.col[k],-L.val[k]);
+            }
+            forEach(cols,k) {
+                Int d = cols[k];
+                if(d == c) {
+                    C.ap[c] = acc[d];
+                } else if(acc[d] != 0) {
+                    C.col.push_back(d);
+                    C.val.push_back(-acc[d]);
+                }
+                acc[d] = 0;
+                pos[d] = none;
+            }
+            C.start[c + 1] = C.col.size();
+        }
+#undef MG_ADD
+    }
+    /** Factorize element blocks of a DG level */
+    void blocks(Level& L) {
+        const Int bs = L.bs;
+        L.lu.assign(L.n * bs,0);
+        L.piv.assign(L.n,0);
+        for(Int i = 0;i < L.n;i++) {
+            Int e = i / bs;
+            Scalar* a = &L.lu[e * bs * bs + (i % bs) * bs];
+            a[i % bs] += L.ap[i];
+            for(Int k = L.start[i];k < L.start[i + 1];k++) {
+                if(L.col[k] / bs == e)
+                    a[L.col[k] % bs] -= L.val[k];
+            }
+        }
+        for(Int e = 0;e < L.n / bs;e++)
+            luFactor(&L.lu[e * bs * bs],&L.piv[e * bs],bs);
+    }
+    /** Gauss-Seidel sweep, by element blocks on DG levels */
+    void smooth(Level& L,bool forward) {
+        if(L.bs > 1) {
+            const Int bs = L.bs, ne = L.n / bs;
+            s.resize(bs);
+            for(Int m = 0;m < ne;m++) {
+                Int e = forward ? m : (ne - 1 - m);
+                for(Int r = 0;r < bs;r++) {
+                    Int i = e * bs + r;
+                    s[r] = L.b[i];
+                    for(Int k = L.start[i];k < L.start[i + 1];k++) {
+                        if(L.col[k] / bs != e)
+                            s[r] += L.x[L.col[k]] * L.val[k];
+                    }
+                }
+                luSolve(&L.lu[e * bs * bs],&L.piv[e * bs],bs,&s[0],false);
+                for(Int r = 0;r < bs;r++)
+                    L.x[e * bs + r] = s[r];
+            }
+            return;
+        }
+        for(Int m = 0;m < L.n;m++) {
+            Int i = forward ? m : (L.n - 1 - m);
+            T3 s = L.b[i];
+            for(Int k = L.start[i];k < L.start[i + 1];k++)
+                s += L.x[L.col[k]] * L.val[k];
+            L.x[i] = s * L.iap[i];
+        }
+    }
+    /** Multigrid cycle on level l */
+    void cycle(Int l) {
+        Level& L = levels[l];
+        if(l + 1 == levels.size()) {
+            for(Int j = 0;j < 4 * Controls::mg_sweeps;j++) {
+                smooth(L,true);
+                smooth(L,false);
+            }
+            return;
+        }
+        Level& C = levels[l + 1];
+        Int ncycles = (Controls::mg_cycle == Controls::W_CYCLE) ? 2 : 1;
+        for(Int j = 0;j < Controls::mg_sweeps;j++)
+            smooth(L,true);
+        /*restrict residual*/
+        C.b.assign(C.n,T3(0));
+        C.x.assign(C.n,T3(0));
+        for(Int i = 0;i < L.n;i++) {
+            T3 r = L.b[i] - L.x[i] * L.ap[i];
+            for(Int k = L.start[i];k < L.start[i + 1];k++)
+                r += L.x[L.col[k]] * L.val[k];
+            for(Int k = L.pstart[i];k < L.pstart[i + 1];k++)
+                C.b[L.pcol[k]] += r * L.pval[k];
+        }
+        for(Int j = 0;j < ncycles;j++)
+            cycle(l + 1);
+        /*prolongate correction*/
+        for(Int i = 0;i < L.n;i++) {
+            for(Int k = L.pstart[i];k < L.pstart[i + 1];k++)
+                L.x[i] += C.x[L.pcol[k]] * L.pval[k];
+        }
+        for(Int j = 0;j < Controls::mg_sweeps;j++)
+            smooth(L,false);
+    }
+public:
+    /** Build hierarchy from matrix */
+    template<class T1,class T2>
+    explicit Multigrid(const MeshMatrix<T1,T2,T3>& M) {
+        using namespace Mesh;
+        using namespace DG;
+        levels.push_back(Level());
+        Level& F = levels.back();
+        F.n = gBCSfield;
+        F.bs = NP;
+        F.ap.resize(F.n);
+        F.start.assign(F.n + 1,0);
+        for(Int i = 0;i < F.n;i++)
+            F.ap[i] = M.ap[i];
+        /*element couplings of DG*/
+        if(NPMAT) {
+            for(Int ci = 0;ci < gBCS;ci++) {
+                forEachLgl(ii,jj,kk) {
+                    Int index1 = INDEX4(ci,ii,jj,kk);
+                    F.ap[index1] -= M.adg[ci * NPMAT + INDEX_X(ii,jj,kk,ii)];
+                    F.start[index1 + 1] += NPI - 3;
+                }
+            }
+        }
+        for(Int f = 0;f < gFacets.size() * NPF;f++) {
+            Int c1 = FO[f], c2 = FN[f];
+            if(c1 < gBCSfield && c2 < gBCSfield) {
+                F.start[c1 + 1]++;
+                F.start[c2 + 1]++;
+            }
+        }
+        for(Int i = 0;i < F.n;i++)
+            F.start[i + 1] += F.start[i];
+        F.col.resize(F.start[F.n]);
+        F.val.resize(F.start[F.n]);
+        IntVector pos(F.start.begin(),F.start.end() - 1);
+        if(NPMAT) {
+            for(Int ci = 0;ci < gBCS;ci++) {
+                forEachLgl(ii,jj,kk) {
+                    Int index1 = INDEX4(ci,ii,jj,kk);
+                    Int& p = pos[index1];
+                    forEachLglX(i) if(i != ii) {
+                        F.col[p] = INDEX4(ci,i,jj,kk);
+                        F.val[p++] = M.adg[ci * NPMAT + INDEX_X(ii,jj,kk,i)];
+                    }
+                    forEachLglY(j) if(j != jj) {
+                        F.col[p] = INDEX4(ci,ii,j,kk);
+                        F.val[p++] = M.adg[ci * NPMAT + INDEX_Y(ii,jj,kk,j)];
+                    }
+                    forEachLglZ(k) if(k != kk) {
+                        F.col[p] = INDEX4(ci,ii,jj,k);
+                        F.val[p++] = M.adg[ci * NPMAT + INDEX_Z(ii,jj,kk,k)];
+                    }
+                }
+            }
+        }
+        for(Int f = 0;f < gFacets.size() * NPF;f++) {
+            Int c1 = FO[f], c2 = FN[f];
+            if(c1 < gBCSfield && c2 < gBCSfield) {
+                F.col[pos[c1]] = c2;
+                F.val[pos[c1]++] = M.an[1][f];
+                F.col[pos[c2]] = c1;
+                F.val[pos[c2]++] = M.an[0][f];
+            }
+        }
+        /*lower polynomial orders*/
+        Int pf[3] = {Nop[0], Nop[1], Nop[2]};
+        while((pf[0] || pf[1] || pf[2])) {
+            Int pc[3];
+            for(Int d = 0;d < 3;d++)
+                pc[d] = pf[d] / 2;
+            Level C;
+            C.n = lower_order(levels.back(),pf,pc);
+            C.bs = C.n / gBCS;
+            coarsen(levels.back(),C);
+            levels.push_back(C);
+            for(Int d = 0;d < 3;d++)
+                pf[d] = pc[d];
+        }
+        /*coarse levels*/
+        while(levels.back().n > 32) {
+            Level& L = levels.back();
+            Int nc = agglomerate(L);
+            if(nc >= L.n) break;
+            Level C;
+            C.n = nc;
+            C.bs = 1;
+            coarsen(L,C);
+            levels.push_back(C);
+        }
+        forEach(levels,l) {
+            Level& L = levels[l];
+            L.iap.resize(L.n);
+            for(Int i = 0;i < L.n;i++)
+                L.iap[i] = 1 / L.ap[i];
+            if(L.bs > 1)
+                blocks(L);
+        }
+    }
+    /** Apply one cycle to R */
+    void apply(const MeshField<T3,CELL>& R,MeshField<T3,CELL>& Z) {
+        Level& F = levels[0];
+        F.b.resize(F.n);
+        F.x.assign(F.n,T3(0));
+        for(Int i = 0;i < F.n;i++)
+            F.b[i] = R[i];
+        cycle(0);
+        for(Int i = 0;i < F.n;i++)
+            Z[i] = F.x[i];
+    }
+};
+/**
+Element block preconditioner. The NP x NP block of each element is
+LU factorized with partial pivoting. With ilu set, each block is first
+modified by the face couplings of the preceding elements, which gives
+a block ILU(0) factorization applied by forward/backward block sweeps.
+*/
+template<class T3>
+class ElementBlocks {
+    Int N;                      /**< Block size */
+    bool ilu;                   /**< Block ILU(0) */
+    ScalarVector A;             /**< Factorized blocks */
+    IntVector piv;              /**< Pivots */
+    IntVector start[2];         /**< Face couplings per element */
+    IntVector row[2],col[2];    /**< Local row and global column */
+    ScalarVector val[2];        /**< Coefficients of couplings */
+    std::vector<T3> y;
+
+    /** Solve with factorized block or its transpose */
+    template<class T>
+    void solve(Int e,T* x,bool tr) const {
+        luSolve(&A[e * N * N],&piv[e * N],N,x,tr);
+    }
+    /** Add face couplings of rows of element e to x */
+    void couple(Int e,T3* x,const MeshField<T3,CELL>& X,bool tr,bool lower) const {
+        for(Int k = start[tr][e];k < start[tr][e + 1];k++) {
+            Int c = col[tr][k];
+            if((c / N < e) == lower) {
+                x[row[tr][k]] += X[c] * val[tr][k];
+            }
+        }
+    }
+public:
+    /** Assemble and factorize element blocks */
+    template<class T1,class T2>
+    ElementBlocks(const MeshMatrix<T1,T2,T3>& M,bool ilu_) : ilu(ilu_) {
+        using namespace Mesh;
+        using namespace DG;
+        N = NP;
+        A.assign(gBCS * N * N,0);
+        piv.assign(gBCS * N,0);
+        /*element blocks*/
+        for(Int ci = 0;ci < gBCS;ci++) {
+            Scalar* a = &A[ci * N * N];
+            forEachLgl(ii,jj,kk) {
+                Int r = INDEX3(ii,jj,kk);
+                a[r * N + r] = M.ap[INDEX4(ci,ii,jj,kk)];
+                if(NPMAT) {
+                    forEachLglX(i)
+                        a[r * N + INDEX3(i,jj,kk)] -= 
+                            M.adg[ci * NPMAT + INDEX_X(ii,jj,kk,i)];
+                    forEachLglY(j) if(j != jj)
+                        a[r * N + INDEX3(ii,j,kk)] -= 
+                            M.adg[ci * NPMAT + INDEX_Y(ii,jj,kk,j)];
+                    forEachLglZ(k) if(k != kk)
+                        a[r * N + INDEX3(ii,jj,k)] -= 
+                            M.adg[ci * NPMAT + INDEX_Z(ii,jj,kk,k)];
+                }
+            }
+        }
+        /*face couplings within the processor, sorted by element*/
+        if(ilu) {
+            for(Int t = 0;t < 2;t++) {
+                start[t].assign(gBCS + 1,0);
+                row[t].clear();
+                col[t].clear();
+                val[t].clear();
+            }
+            std::vector< std::vector<Int> > fc(gBCS);
+            for(Int k = 0;k < gFacets.size() * NPF;k++) {
+                Int c1 = FO[k], c2 = FN[k];
+                if(c1 < gBCSfield && c2 < gBCSfield && c1 / N != c2 / N) {
+                    fc[c1 / N].push_back(k);
+                    fc[c2 / N].push_back(k);
+                }
+            }
+            for(Int e = 0;e < gBCS;e++) {
+                forEach(fc[e],m) {
+                    Int k = fc[e][m];
+                    Int c1 = FO[k], c2 = FN[k];
+                    bool own = (c1 / N == e);
+                    for(Int t = 0;t < 2;t++) {
+                        row[t].push_back((own ? c1 : c2) % N);
+                        col[t].push_back(own ? c2 : c1);
+                        val[t].push_back(own ? M.an[1 - t][k] : M.an[t][k]);
+                    }
+                }
+                for(Int t = 0;t < 2;t++)
+                    start[t][e + 1] = col[t].size();
+            }
+        }
+        /*factorize*/
+        ScalarVector x(N);
+        for(Int e = 0;e < gBCS;e++) {
+            luFactor(&A[e * N * N],&piv[e * N],N);
+            if(!ilu) continue;
+            /*Schur complement update of neighbouring blocks*/
+            for(Int k = start[0][e];k < start[0][e + 1];k++) {
+                Int q = col[0][k];
+                Int f = q / N;
+                if(f <= e || val[0][k] == 0) continue;
+                Int p = row[0][k];
+                x.assign(N,0);
+                x[p] = val[0][k];
+                solve(e,&x[0],false);
+                Scalar* af = &A[f * N * N];
+                for(Int l = start[0][f];l < start[0][f + 1];l++) {
+                    Int b = col[0][l];
+                    if(b / N != e || val[0][l] == 0) continue;
+                    Int a = row[0][l];
+                    af[a * N + (q % N)] -= val[0][l] * x[b % N];
+                }
+            }
+        }
+        y.resize(gBCS * N);
+    }
+    /** Apply preconditioner to R */
+    void apply(const MeshField<T3,CELL>& R,MeshField<T3,CELL>& Z,bool tr) {
+        using namespace Mesh;
+        if(!ilu) {
+            for(Int e = 0;e < gBCS;e++) {
+                T3* x = &Z[e * N];
+                for(Int i = 0;i < N;i++)
+                    x[i] = R[e * N + i];
+                solve(e,x,tr);
+            }
+            return;
+        }
+        /*forward block sweep*/
+        for(Int e = 0;e < gBCS;e++) {
+            T3* x = &Z[e * N];
+            for(Int i = 0;i < N;i++)
+                x[i] = R[e * N + i];
+            couple(e,x,Z,tr,true);
+            solve(e,x,tr);
+        }
+        /*backward block sweep*/
+        for(Int e = gBCS;e-- > 0;) {
+            T3* x = &y[e * N];
+            for(Int i = 0;i < N;i++)
+                x[i] = T3(0);
+            couple(e,x,Z,tr,false);
+            solve(e,x,tr);
+            for(Int i = 0;i < N;i++)
+                Z[e * N + i] += x[i];
+        }
+    }
+};
+/**
+Diagonal of the SSOR or D-ILU(0) preconditioner of a symmetric matrix
+and its inverse
+*/
+template<class T1, class T2, class T3>
+void factorDiagonal(const MeshMatrix<T1,T2,T3>& M,MeshField<T2,CELL>& D,
+                    MeshField<T2,CELL>& iD) {
+    using namespace Mesh;
+    using namespace DG;
+    if(Controls::Preconditioner == Controls::SSOR) {
+        /*SSOR pre-conditioner*/
+        iD *= Controls::SOR_omega;
+        D *=  (2.0 / Controls::SOR_omega - 1.0);    
+    } else if(Controls::Preconditioner == Controls::DILU) {
+        /*D-ILU(0) pre-conditioner*/
+        for(Int ci = 0;ci < gBCS;ci++) {
+            Cell& c = gCells[ci];
+            forEachLgl(ii,jj,kk) {
+                Int index1 = INDEX4(ci,ii,jj,kk);
+                if(NPMAT) {
+                    T2 val = T2(0);
+                    forEachLglX(i) {
+                        Int index2 = INDEX4(ci,i,jj,kk);
+                        if(index1 > index2) {
+                            val += iD[index2] * 
+                                   M.adg[ci * NPMAT + INDEX_X(ii,jj,kk,i)] *
+                                   M.adg[ci * NPMAT + INDEX_TX(ii,jj,kk,i)];
+                        }
+                    }
+                    forEachLglY(j) if(j != jj) {
+                        Int index2 = INDEX4(ci,ii,j,kk);
+                        if(index1 > index2) {
+                            val += iD[index2] * 
+                                   M.adg[ci * NPMAT + INDEX_Y(ii,jj,kk,j)] *
+                                   M.adg[ci * NPMAT + INDEX_TY(ii,jj,kk,j)];
+                        }
+                    }
+                    forEachLglZ(k) if(k != kk) {
+                        Int index2 = INDEX4(ci,ii,jj,k);
+                        if(index1 > index2) {
+                            val += iD[index2] * 
+                                   M.adg[ci * NPMAT + INDEX_Z(ii,jj,kk,k)] *
+                                   M.adg[ci * NPMAT + INDEX_TZ(ii,jj,kk,k)];
+                        }
+                    }
+                    D[index1] -= val;
+                }   
+                if(isBoundary(ii,jj,kk)) {
+                    forEach(c,j) {                              
+                        Int faceid = c[j];
+                        for(Int n = 0; n < NPF;n++) {
+                            Int k = faceid * NPF + n;                           
+                            Int c1 = FO[k];                     
+                            Int c2 = FN[k];                     
+                            if(index1 == c1) {
+                                if(c2 > c1) D[c2] -= 
+                                (M.an[0][k] * M.an[1][k] * iD[c1]); 
+                            } else if(index1 == c2) {
+                                if(c1 > c2) D[c1] -= 
+                                (M.an[0][k] * M.an[1][k] * iD[c2]);     
+                            }       
+                        }                               
+                    }
+                }
+            }           
+        }
+        iD = (T2(1) / D);
+    }
+}
+/**
 Solve a system of linear equations Ax=B
 */
 template<class T1, class T2, class T3>
@@ -35,9 +726,12 @@ void SolveT(const MeshMatrix<T1,T2,T3>& M) {
     using namespace DG;
     MeshField<T3,CELL> r,p,AP = T3(0);
     MeshField<T3,CELL> r1(false),p1(false),AP1(false);   
+    MeshField<T1,CELL> cF0(false);
     MeshField<T1,CELL>& cF = *M.cF;
     MeshField<T3,CELL>& buffer = AP;
     MeshField<T2,CELL> D = M.ap,iD = (T2(1) / M.ap);
+    Multigrid<T3>* mg = 0;
+    ElementBlocks<T3>* blk = 0;
     Scalar res,ires;
     T1 alpha,beta,o_rr = T1(0),oo_rr;
     Int iterations = 0;
@@ -51,6 +745,21 @@ void SolveT(const MeshMatrix<T1,T2,T3>& M) {
         && gInterMesh.size();
     std::vector<bool> sent_end(gInterMesh.size(),false);
 
+    /****************************
+     * Null space of singular systems
+     ***************************/
+    bool gsync = (MP::n_hosts > 1);
+    bool singular = (M.flags & M.SYMMETRIC) && isSingular(M,gsync);
+    bool deflate = singular && (sync || !gsync);
+    T3 mean0 = T3(0);
+    if(singular) {
+        /*make the rhs consistent and remember the level of the solution*/
+        mean0 = getMean(cF,gsync);
+        T3 meanSu = getMean(M.Su,gsync);
+        for(Int i = 0;i < gBCSfield;i++)
+            M.Su[i] -= meanSu;
+    }
+
     /****************************
      * Jacobi sweep
      ***************************/
@@ -194,6 +903,10 @@ void SolveT(const MeshMatrix<T1,T2,T3>& M) {
         Z = R;                                      \
     } else if(Preconditioner == Controls::DIAG) {   \
         DiagSub(Z,R);                               \
+    } else if(mg) {                                 \
+        mg->apply(R,Z);                             \
+    } else if(blk) {                                \
+        blk->apply(R,Z,TR);                         \
     } else {                                        \
         if(Controls::Solver == Controls::PCG) {     \
             ForwardSub(Z,R,TR);                     \
@@ -202,7 +915,14 @@ void SolveT(const MeshMatrix<T1,T2,T3>& M) {
         }                                           \
     }                                               \
 }
-#define precondition(R,Z) precondition_(R,Z,0)
+#define precondition(R,Z) {                         \
+    precondition_(R,Z,0);                           \
+    if(deflate) {                                   \
+        T3 mean_ = getMean(Z,sync);                 \
+        for(Int i = 0;i < gBCSfield;i++)            \
+            Z[i] -= mean_;                          \
+    }                                               \
+}
 #define preconditionT(R,Z) precondition_(R,Z,1)
     /***********************************
      *  SAXPY and DOT operations
@@ -255,73 +975,33 @@ void SolveT(const MeshMatrix<T1,T2,T3>& M) {
             p1.allocate();
             AP1.allocate();
         } else {
-            if(Controls::Preconditioner == Controls::SSOR) {
-                /*SSOR pre-conditioner*/
-                iD *= Controls::SOR_omega;
-                D *=  (2.0 / Controls::SOR_omega - 1.0);    
-            } else if(Controls::Preconditioner == Controls::DILU) {
-                /*D-ILU(0) pre-conditioner*/
-                for(Int ci = 0;ci < gBCS;ci++) {
-                    Cell& c = gCells[ci];
-                    forEachLgl(ii,jj,kk) {
-                        Int index1 = INDEX4(ci,ii,jj,kk);
-                        if(NPMAT) {
-                            T2 val = T2(0);
-                            forEachLglX(i) {
-                                Int index2 = INDEX4(ci,i,jj,kk);
-                                if(index1 > index2) {
-                                    val += iD[index2] * 
-                                           M.adg[ci * NPMAT + INDEX_X(ii,jj,kk,i)] *
-                                           M.adg[ci * NPMAT + INDEX_TX(ii,jj,kk,i)];
-                                }
-                            }
-                            forEachLglY(j) if(j != jj) {
-                                Int index2 = INDEX4(ci,ii,j,kk);
-                                if(index1 > index2) {
-                                    val += iD[index2] * 
-                                           M.adg[ci * NPMAT + INDEX_Y(ii,jj,kk,j)] *
-                                           M.adg[ci * NPMAT + INDEX_TY(ii,jj,kk,j)];
-                                }
-                            }
-                            forEachLglZ(k) if(k != kk) {
-                                Int index2 = INDEX4(ci,ii,jj,k);
-                                if(index1 > index2) {
-                                    val += iD[index2] * 
-                                           M.adg[ci * NPMAT + INDEX_Z(ii,jj,kk,k)] *
-                                           M.adg[ci * NPMAT + INDEX_TZ(ii,jj,kk,k)];
-                                }
-                            }
-                            D[index1] -= val;
-                        }   
-                        if(isBoundary(ii,jj,kk)) {
-                            forEach(c,j) {                              
-                                Int faceid = c[j];
-                                for(Int n = 0; n < NPF;n++) {
-                                    Int k = faceid * NPF + n;                           
-                                    Int c1 = FO[k];                     
-                                    Int c2 = FN[k];                     
-                                    if(index1 == c1) {
-                                        if(c2 > c1) D[c2] -= 
-                                        (M.an[0][k] * M.an[1][k] * iD[c1]); 
-                                    } else if(index1 == c2) {
-                                        if(c1 > c2) D[c1] -= 
-                                        (M.an[0][k] * M.an[1][k] * iD[c2]);     
-                                    }       
-                                }                               
-                            }
-                        }
-                    }           
-                }
-                iD = (T2(1) / D);
+            if(Controls::Preconditioner == Controls::SSOR ||
+               Controls::Preconditioner == Controls::DILU) {
+                factorDiagonal(M,D,iD);
+            } else if(Controls::Preconditioner == Controls::GMG) {
+                /*geometric multigrid pre-conditioner*/
+                mg = new Multigrid<T3>(M);
             }
             /*end*/
         }
+        if(Controls::Preconditioner == Controls::BJAC ||
+           Controls::Preconditioner == Controls::BILU) {
+            /*element block pre-conditioners*/
+            blk = new ElementBlocks<T3>(M,
+                Controls::Preconditioner == Controls::BILU);
+        }
     }
     /***********************
      *  Initialize residual
      ***********************/
     CALC_RESID();
     ires = res;
+    bool monitor = (Controls::state == Controls::STEADY && 
+                    Controls::steady_tolerance > 0);
+    if(monitor) {
+        cF0.allocate();
+        cF0 = cF;
+    }
     /********************************************************
     * Initialize exchange of ghost cells just once.
     * Lower numbered processors send message to higher ones.
@@ -491,6 +1171,19 @@ PROBE:
          * end
          ********/
     }
+    /*restore level of the solution*/
+    if(singular) {
+        T3 shift = mean0 - getMean(cF,gsync);
+        for(Int i = 0;i < gBCSfield;i++)
+            cF[i] += shift;
+    }
+    /*outer residual and solution change*/
+    if(monitor) {
+        for(Int i = 0;i < gBCSfield;i++)
+            cF0[i] = cF[i] - cF0[i];
+        Residuals::record(cF.fName,ires);
+        Residuals::record(cF.fName,getResidual(cF0,cF,sync));
+    }
     /****************************
      * Iteration info
      ***************************/
@@ -509,11 +1202,40 @@ PROBE:
             case Controls::DIAG: MP::print("DIAG-PCG :"); break;
             case Controls::SSOR: MP::print("SSOR-PCG :"); break;
             case Controls::DILU: MP::print("DILU-PCG :"); break;
+            case Controls::GMG:  MP::print("GMG-PCG :"); break;
+            case Controls::BJAC: MP::print("BJAC-PCG :"); break;
+            case Controls::BILU: MP::print("BILU-PCG :"); break;
             }
         }
         MP::print("Iterations %d Initial Residual "
         "%.5e Final Residual %.5e\n",iterations,ires,res);
     }
+    delete mg;
+    delete blk;
+}
+/**
+Apply the preconditioner of a matrix once, Z = P^-1 R, as the
+first iteration of Solve would. DIAG and NOPR use the diagonal,
+and the other preconditioners a symmetric Gauss-Seidel sweep with
+the SSOR or D-ILU(0) diagonal.
+*/
+template<class T1, class T2, class T3>
+void PreconditionT(const MeshMatrix<T1,T2,T3>& M,const MeshField<T3,CELL>& R,
+                   MeshField<T3,CELL>& Z) {
+    using namespace Mesh;
+    using namespace DG;
+    MeshField<T2,CELL> D = M.ap,iD = (T2(1) / M.ap);
+    if(Controls::Preconditioner == Controls::NOPR ||
+       Controls::Preconditioner == Controls::DIAG) {
+        DiagSub(Z,R);
+        return;
+    }
+    if(M.flags & M.SYMMETRIC)
+        factorDiagonal(M,D,iD);
+    Z = T3(0);
+    ForwardSub(Z,R,0);
+    Z = Z * D;
+    BackwardSub(Z,Z,0);
 }
 /**
 Solve a diagonal system
@@ -527,6 +1249,632 @@ void SolveTexplicit(const MeshMatrix<T1,T2,T3>& M) {
         "%.5e Final Residual %.5e\n",1,0.0,0.0);
     }
 }
+/* ***************************
+ * Restarted GMRES
+ * ***************************/
+
+/** Global dot product of flat vectors */
+static Scalar dot(const ScalarVector& a,const ScalarVector& b) {
+    Scalar s = 0, gs;
+    forEach(a,i)
+        s += a[i] * b[i];
+    MP::allreduce(&s,&gs,1,MP::OP_SUM);
+    return gs;
+}
+Scalar KrylovOperator::norm(const ScalarVector& r) {
+    return sqrt(dot(r,r));
+}
+/**
+Solve A * x = b with right preconditioned GMRES(m). Within a cycle the
+residual is estimated from the Hessenberg system, and it is recomputed
+from x before each restart. Returns the number of iterations together
+with the initial and final residual measured by A.norm().
+*/
+Int GMRES(KrylovOperator& A,const ScalarVector& b,ScalarVector& x,Int m,
+          Scalar tolerance,Int max_iterations,Scalar& ires,Scalar& res) {
+    const Int n = x.size();
+    Int iterations = 0;
+    ScalarVector r(n), w(n);
+    std::vector<ScalarVector> V(m + 1), Z(m,ScalarVector(n));
+    ScalarVector H((m + 1) * m), cs(m), sn(m), g(m + 1), y(m);
+    
+    /*initial residual*/
+    A.mul(x,w);
+    for(Int i = 0;i < n;i++)
+        r[i] = b[i] - w[i];
+    Scalar beta = sqrt(dot(r,r));
+    ires = res = A.norm(r);
+    
+    while(res > tolerance && iterations < max_iterations) {
+        V[0] = r;
+        for(Int i = 0;i < n;i++)
+            V[0][i] /= beta;
+        g.assign(m + 1,Scalar(0));
+        g[0] = beta;
+        Scalar scale = res / beta;
+        Int k = 0;
+        for(;k < m && iterations < max_iterations;k++) {
+            iterations++;
+            A.precond(V[k],Z[k]);
+            A.mul(Z[k],w);
+            /*Arnoldi*/
+            for(Int l = 0;l <= k;l++) {
+                Scalar h = dot(w,V[l]);
+                H[l * m + k] = h;
+                for(Int i = 0;i < n;i++)
+                    w[i] -= h * V[l][i];
+            }
+            Scalar h = sqrt(dot(w,w));
+            H[(k + 1) * m + k] = h;
+            V[k + 1] = w;
+            if(h > 0) {
+                for(Int i = 0;i < n;i++)
+                    V[k + 1][i] /= h;
+            }
+            /*Givens rotations*/
+            for(Int l = 0;l < k;l++) {
+                Scalar t = cs[l] * H[l * m + k] + sn[l] * H[(l + 1) * m + k];
+                H[(l + 1) * m + k] = -sn[l] * H[l * m + k] + cs[l] * H[(l + 1) * m + k];
+                H[l * m + k] = t;
+            }
+            Scalar d = sqrt(H[k * m + k] * H[k * m + k] + h * h);
+            cs[k] = H[k * m + k] / d;
+            sn[k] = h / d;
+            H[k * m + k] = d;
+            H[(k + 1) * m + k] = 0;
+            g[k + 1] = -sn[k] * g[k];
+            g[k] = cs[k] * g[k];
+            res = scale * fabs(g[k + 1]);
+            if(res <= tolerance) {
+                k++;
+                break;
+            }
+        }
+        /*update solution*/
+        for(Int l = k;l-- > 0;) {
+            Scalar s = g[l];
+            for(Int q = l + 1;q < k;q++)
+                s -= H[l * m + q] * y[q];
+            y[l] = s / H[l * m + l];
+        }
+        for(Int l = 0;l < k;l++) {
+            for(Int i = 0;i < n;i++)
+                x[i] += y[l] * Z[l][i];
+        }
+        /*true residual for restart*/
+        if(res > tolerance) {
+            A.mul(x,w);
+            for(Int i = 0;i < n;i++)
+                r[i] = b[i] - w[i];
+            beta = sqrt(dot(r,r));
+            res = A.norm(r);
+        }
+    }
+    return iterations;
+}
+/* ***************************
+ * Block-sparse coupled systems
+ * ***************************/
+typedef std::vector<ScalarCellField> BlockField;
+
+/** Update ghost cells of all components */
+static void exchange(BlockField& x) {
+    if(!Mesh::gInterMesh.size())
+        return;
+    forEach(x,j) {
+        ASYNC_COMM<Scalar> comm(&x[j][0]);
+        comm.send();
+        comm.recv();
+    }
+}
+/** y = A * x */
+static void mul(BlockMatrix& M,BlockField& x,BlockField& y) {
+    using namespace Mesh;
+    const Int N = M.N;
+    exchange(x);
+    for(Int c = 0;c < gBCS;c++) {
+        const Scalar* a = M.AP(c);
+        for(Int r = 0;r < N;r++) {
+            Scalar s = 0;
+            for(Int j = 0;j < N;j++)
+                s += a[r * N + j] * x[j][c];
+            y[r][c] = s;
+        }
+    }
+    forEach(gFacets,k) {
+        Int c1 = gFOC[k];
+        Int c2 = gFNC[k];
+        const Scalar* a1 = M.AN(1,k);
+        const Scalar* a0 = M.AN(0,k);
+        for(Int r = 0;r < N;r++) {
+            for(Int j = 0;j < N;j++) {
+                y[r][c1] -= a1[r * N + j] * x[j][c2];
+                if(c2 < gBCS)
+                    y[r][c2] -= a0[r * N + j] * x[j][c1];
+            }
+        }
+    }
+}
+/**
+Block Jacobi or block ILU(0) preconditioner. The ILU variant keeps
+the sparsity of the cell graph, so only the diagonal blocks change.
+Coupling to other processors is dropped.
+*/
+class BlockPreconditioner {
+    BlockMatrix& M;
+    bool ilu;
+    ScalarVector D;
+    IntVector piv;
+    
+    /*couple(i,j) = -A[i][j] over face k, i.e. the stored block*/
+    const Scalar* couple(Int k,Int i) {
+        return (i == Mesh::gFOC[k]) ? M.AN(1,k) : M.AN(0,k);
+    }
+public:
+    BlockPreconditioner(BlockMatrix& M_,bool ilu_) : M(M_), ilu(ilu_) {
+        using namespace Mesh;
+        const Int N = M.N, NN = N * N;
+        D = M.ap;
+        piv.resize(gBCS * N);
+        ScalarVector t(NN), col(N);
+        for(Int i = 0;i < gBCS;i++) {
+            if(ilu) {
+                /*D_i -= A_ij * inv(D_j) * A_ji for lower neighbors*/
+                Cell& c = gCells[i];
+                forEach(c,m) {
+                    Int k = c[m];
+                    Int j = (gFOC[k] == i) ? gFNC[k] : gFOC[k];
+                    if(j >= i || j >= gBCS) continue;
+                    const Scalar* aij = couple(k,i);
+                    const Scalar* aji = couple(k,j);
+                    for(Int q = 0;q < N;q++) {
+                        for(Int r = 0;r < N;r++)
+                            col[r] = aji[r * N + q];
+                        luSolve(&D[j * NN],&piv[j * N],N,&col[0],false);
+                        for(Int r = 0;r < N;r++)
+                            t[r * N + q] = col[r];
+                    }
+                    for(Int r = 0;r < N;r++) {
+                        for(Int q = 0;q < N;q++) {
+                            Scalar s = 0;
+                            for(Int l = 0;l < N;l++)
+                                s += aij[r * N + l] * t[l * N + q];
+                            D[i * NN + r * N + q] -= s;
+                        }
+                    }
+                }
+            }
+            luFactor(&D[i * NN],&piv[i * N],N);
+        }
+    }
+    /** Z = inv(P) * R */
+    void apply(const BlockField& R,BlockField& Z) {
+        using namespace Mesh;
+        const Int N = M.N, NN = N * N;
+        ScalarVector s(N);
+        /*forward*/
+        for(Int i = 0;i < gBCS;i++) {
+            for(Int r = 0;r < N;r++)
+                s[r] = R[r][i];
+            if(ilu) {
+                Cell& c = gCells[i];
+                forEach(c,m) {
+                    Int k = c[m];
+                    Int j = (gFOC[k] == i) ? gFNC[k] : gFOC[k];
+                    if(j >= i || j >= gBCS) continue;
+                    const Scalar* aij = couple(k,i);
+                    for(Int r = 0;r < N;r++)
+                        for(Int q = 0;q < N;q++)
+                            s[r] += aij[r * N + q] * Z[q][j];
+                }
+            }
+            luSolve(&D[i * NN],&piv[i * N],N,&s[0],false);
+            for(Int r = 0;r < N;r++)
+                Z[r][i] = s[r];
+        }
+        if(!ilu) return;
+        /*backward*/
+        for(Int i = gBCS;i-- > 0;) {
+            for(Int r = 0;r < N;r++)
+                s[r] = 0;
+            Cell& c = gCells[i];
+            forEach(c,m) {
+                Int k = c[m];
+                Int j = (gFOC[k] == i) ? gFNC[k] : gFOC[k];
+                if(j <= i || j >= gBCS) continue;
+                const Scalar* aij = couple(k,i);
+                for(Int r = 0;r < N;r++)
+                    for(Int q = 0;q < N;q++)
+                        s[r] += aij[r * N + q] * Z[q][j];
+            }
+            luSolve(&D[i * NN],&piv[i * N],N,&s[0],false);
+            for(Int r = 0;r < N;r++)
+                Z[r][i] += s[r];
+        }
+    }
+};
+/**
+Block system on flat vectors that hold the components one after another.
+The residual norm is scaled by the diagonal of A, so it is insensitive 
+to fixed rows, and normalized by that of the source.
+*/
+class BlockOperator : public KrylovOperator {
+    BlockMatrix& M;
+    BlockPreconditioner* P;
+    BlockField bx, by;
+    Scalar bnorm;
+    
+    void unpack(const ScalarVector& v,BlockField& f) {
+        for(Int j = 0;j < M.N;j++)
+            for(Int i = 0;i < Mesh::gBCS;i++)
+                f[j][i] = v[j * Mesh::gBCS + i];
+    }
+    void pack(const BlockField& f,ScalarVector& v) {
+        v.resize(M.N * Mesh::gBCS);
+        for(Int j = 0;j < M.N;j++)
+            for(Int i = 0;i < Mesh::gBCS;i++)
+                v[j * Mesh::gBCS + i] = f[j][i];
+    }
+    Scalar scaledNorm(const ScalarVector& r) {
+        const Int N = M.N;
+        Scalar s = 0, gs;
+        for(Int j = 0;j < N;j++) {
+            for(Int i = 0;i < Mesh::gBCS;i++) {
+                Scalar v = r[j * Mesh::gBCS + i] / M.AP(i)[j * N + j];
+                s += v * v;
+            }
+        }
+        MP::allreduce(&s,&gs,1,MP::OP_SUM);
+        return sqrt(gs);
+    }
+public:
+    BlockOperator(BlockMatrix& M_,BlockPreconditioner* P_,const ScalarVector& b) :
+        M(M_), P(P_), bx(M_.N), by(M_.N) {
+        for(Int j = 0;j < M.N;j++) {
+            bx[j] = Scalar(0);
+            by[j] = Scalar(0);
+        }
+        bnorm = scaledNorm(b);
+        if(bnorm == 0) bnorm = 1;
+    }
+    void mul(const ScalarVector& x,ScalarVector& y) {
+        unpack(x,bx);
+        ::mul(M,bx,by);
+        pack(by,y);
+    }
+    void precond(const ScalarVector& v,ScalarVector& z) {
+        if(!P) {
+            z = v;
+            return;
+        }
+        unpack(v,bx);
+        P->apply(bx,by);
+        pack(by,z);
+    }
+    Scalar norm(const ScalarVector& r) {
+        return scaledNorm(r) / bnorm;
+    }
+};
+/**
+Solve a block-sparse system with restarted GMRES, right preconditioned
+by block Jacobi (DIAG, BJAC) or block ILU(0) (other preconditioners)
+*/
+void Solve(BlockMatrix& M) {
+    using namespace Mesh;
+    const Int N = M.N;
+    Scalar ires, res;
+    
+    /*preconditioner*/
+    BlockPreconditioner* P = 0;
+    if(Controls::Preconditioner != Controls::NOPR) {
+        bool ilu = (Controls::Preconditioner != Controls::DIAG &&
+                    Controls::Preconditioner != Controls::BJAC);
+        P = new BlockPreconditioner(M,ilu);
+    }
+    
+    /*flat source and solution*/
+    ScalarVector b(N * gBCS), x(N * gBCS);
+    for(Int j = 0;j < N;j++) {
+        for(Int i = 0;i < gBCS;i++) {
+            b[j * gBCS + i] = M.Su[j][i];
+            x[j * gBCS + i] = (*M.cF[j])[i];
+        }
+    }
+    
+    BlockOperator A(M,P,b);
+    Int iterations = GMRES(A,b,x,30,Controls::tolerance,
+                           Controls::max_iterations,ires,res);
+    if(Controls::state == Controls::STEADY && Controls::steady_tolerance > 0)
+        Residuals::record(M.cF[0]->fName,ires);
+    
+    /*copy solution*/
+    for(Int j = 0;j < N;j++) {
+        for(Int i = 0;i < gBCS;i++)
+            (*M.cF[j])[i] = x[j * gBCS + i];
+    }
+    
+    /*iteration info*/
+    if(MP::printOn) {
+        MP::printH("BLOCK-");
+        switch(Controls::Preconditioner) {
+        case Controls::NOPR: MP::print("NONE-GMRES :"); break;
+        case Controls::DIAG: 
+        case Controls::BJAC: MP::print("BJAC-GMRES :"); break;
+        default:             MP::print("BILU-GMRES :"); break;
+        }
+        MP::print("Iterations %d Initial Residual "
+        "%.5e Final Residual %.5e\n",iterations,ires,res);
+    }
+    delete P;
+}
+/* ***************************
+ * Active set of a localized scalar
+ * ***************************/
+
+/**
+Seed the set with cells whose value, or whose source after removing the
+diagonal part, exceeds the threshold and add halo layers through faces
+*/
+void ActiveSet::grow(const MeshMatrix<Scalar>& M) {
+    using namespace Mesh;
+    const ScalarCellField& cF = *M.cF;
+    if(index.size() != gBCS)
+        index.assign(gBCS,Int(-1));
+    else {
+        forEach(cells,i)
+            index[cells[i]] = Int(-1);
+    }
+    cells.clear();
+    for(Int i = 0;i < gBCS;i++) {
+        if(fabs(cF[i]) > threshold ||
+           fabs(M.Su[i] - M.ap[i] * cF[i]) > threshold * fabs(M.ap[i])) {
+            index[i] = cells.size();
+            cells.push_back(i);
+        }
+    }
+    outer = 0;
+    for(Int l = 0;l < layers;l++) {
+        Int end = cells.size();
+        for(Int i = outer;i < end;i++) {
+            Int ci = cells[i];
+            Cell& c = gCells[ci];
+            forEach(c,j) {
+                Int f = c[j];
+                Int o = (FO[f] == ci) ? FN[f] : FO[f];
+                if(o < gBCS && index[o] == Int(-1)) {
+                    index[o] = cells.size();
+                    cells.push_back(o);
+                }
+            }
+        }
+        outer = end;
+    }
+}
+/**
+Solve a scalar system on an active set. Couplings to inactive cells go
+to the right-hand side, and the compact system is solved with CG or BiCG
+and the SSOR/DILU, diagonal or no preconditioner of the full solver; the
+other preconditioners fall back to symmetric Gauss-Seidel.
+*/
+void Solve(const MeshMatrix<Scalar>& M,ActiveSet& S) {
+    using namespace Mesh;
+    using namespace Controls;
+    if(S.threshold <= 0 || DG::NPMAT || MP::n_hosts > 1 ||
+       (M.flags & M.DIAGONAL)) {
+        Solve(M);
+        return;
+    }
+    applyImplicitBCs(M);
+
+    ScalarCellField& cF = *M.cF;
+    bool symmetric = (M.flags & M.SYMMETRIC);
+    bool monitor = (state == STEADY && steady_tolerance > 0);
+    Scalar res = 0,ires = 0,dx = 0,x2 = 0;
+    Int iterations = 0,passes = 0;
+
+    S.grow(M);
+    while(true) {
+        passes++;
+        Int n = S.cells.size();
+
+        /*compact system*/
+        IntVector row(n + 1,0),col;
+        ScalarVector a,at,b(n),x(n),x0,D(n),iD(n);
+        for(Int i = 0;i < n;i++) {
+            Int ci = S.cells[i];
+            Cell& c = gCells[ci];
+            b[i] = M.Su[ci];
+            x[i] = cF[ci];
+            forEach(c,j) {
+                Int f = c[j];
+                Int o;
+                Scalar ao,aot;
+                if(FO[f] == ci) {
+                    o = FN[f];
+                    ao = M.an[1][f];
+                    aot = M.an[0][f];
+                } else {
+                    o = FO[f];
+                    ao = M.an[0][f];
+                    aot = M.an[1][f];
+                }
+                if(o < gBCS && S.index[o] != Int(-1)) {
+                    col.push_back(S.index[o]);
+                    a.push_back(ao);
+                    at.push_back(aot);
+                } else {
+                    b[i] += ao * cF[o];
+                }
+            }
+            row[i + 1] = col.size();
+        }
+        if(monitor)
+            x0 = x;
+
+        /*preconditioner*/
+        for(Int i = 0;i < n;i++)
+            D[i] = M.ap[S.cells[i]];
+        if(symmetric && Preconditioner == DILU) {
+            for(Int i = 0;i < n;i++) {
+                for(Int k = row[i];k < row[i + 1];k++) {
+                    if(col[k] < i)
+                        D[i] -= a[k] * at[k] / M.ap[S.cells[col[k]]];
+                }
+            }
+        }
+        for(Int i = 0;i < n;i++)
+            iD[i] = 1 / D[i];
+        if(symmetric && Preconditioner == SSOR) {
+            for(Int i = 0;i < n;i++) {
+                iD[i] *= SOR_omega;
+                D[i] *= (2.0 / SOR_omega - 1.0);
+            }
+        }
+
+        /*operations on the compact system*/
+#define AMUL(X,Y,A) {                                       \
+    for(Int i = 0;i < n;i++) {                              \
+        Scalar s = M.ap[S.cells[i]] * X[i];                 \
+        for(Int k = row[i];k < row[i + 1];k++)              \
+            s -= A[k] * X[col[k]];                          \
+        Y[i] = s;                                           \
+    }                                                       \
+}
+#define APRECOND(R,Z,A) {                                   \
+    if(Preconditioner == NOPR) {                            \
+        Z = R;                                              \
+    } else if(Preconditioner == Controls::DIAG) {           \
+        for(Int i = 0;i < n;i++)                            \
+            Z[i] = R[i] / M.ap[S.cells[i]];                 \
+    } else {                                                \
+        for(Int i = 0;i < n;i++) {                          \
+            Scalar s = R[i];                                \
+            for(Int k = row[i];k < row[i + 1];k++)          \
+                if(col[k] < i) s += A[k] * Z[col[k]];       \
+            Z[i] = s * iD[i];                               \
+        }                                                   \
+        for(Int i = 0;i < n;i++)                            \
+            Z[i] *= D[i];                                   \
+        for(Int i = n;i-- > 0;) {                           \
+            Scalar s = Z[i];                                \
+            for(Int k = row[i];k < row[i + 1];k++)          \
+                if(col[k] > i) s += A[k] * Z[col[k]];       \
+            Z[i] = s * iD[i];                               \
+        }                                                   \
+    }                                                       \
+}
+#define ADOT(X,Y,sum) {                                     \
+    sum = 0;                                                \
+    for(Int i = 0;i < n;i++)                                \
+        sum += X[i] * Y[i];                                 \
+}
+#define ARESID() {                                          \
+    Scalar z2;                                              \
+    ADOT(AP,AP,z2);                                         \
+    ADOT(x,x,x2);                                           \
+    res = sqrt(sdiv(z2,x2));                                \
+}
+        /*initial residual*/
+        ScalarVector r(n),p(n),AP(n),r1,p1,AP1;
+        Scalar alpha,beta,o_rr,oo_rr;
+        AMUL(x,r,a);
+        for(Int i = 0;i < n;i++)
+            r[i] = b[i] - r[i];
+        APRECOND(r,AP,a);
+        ARESID();
+        if(passes == 1)
+            ires = res;
+        ADOT(r,AP,o_rr);
+        p = AP;
+        if(!symmetric) {
+            r1 = r;
+            p1 = p;
+            AP1.resize(n);
+        }
+
+        /*iterative solution*/
+        Int iter = 0;
+        while(res > tolerance && iter < max_iterations) {
+            iter++;
+            AMUL(p,AP,a);
+            if(symmetric) {
+                ADOT(p,AP,oo_rr);
+            } else {
+                AMUL(p1,AP1,at);
+                ADOT(p1,AP,oo_rr);
+            }
+            alpha = sdiv(o_rr,oo_rr);
+            for(Int i = 0;i < n;i++) {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * AP[i];
+            }
+            APRECOND(r,AP,a);
+            oo_rr = o_rr;
+            if(symmetric) {
+                ADOT(r,AP,o_rr);
+            } else {
+                for(Int i = 0;i < n;i++)
+                    r1[i] -= alpha * AP1[i];
+                APRECOND(r1,AP1,at);
+                ADOT(r1,AP,o_rr);
+            }
+            beta = sdiv(o_rr,oo_rr);
+            for(Int i = 0;i < n;i++)
+                p[i] = AP[i] + beta * p[i];
+            if(!symmetric) {
+                for(Int i = 0;i < n;i++)
+                    p1[i] = AP1[i] + beta * p1[i];
+            }
+            ARESID();
+        }
+        iterations += iter;
+#undef AMUL
+#undef APRECOND
+#undef ADOT
+#undef ARESID
+
+        /*scatter solution*/
+        for(Int i = 0;i < n;i++)
+            cF[S.cells[i]] = x[i];
+        if(monitor) {
+            for(Int i = 0;i < n;i++)
+                dx += (x[i] - x0[i]) * (x[i] - x0[i]);
+        }
+
+        /*grow the set if the solution reached its outer layer*/
+        bool reached = false;
+        if(S.layers && n < gBCS) {
+            for(Int i = S.outer;i < n;i++) {
+                if(fabs(x[i]) > S.threshold) {
+                    reached = true;
+                    break;
+                }
+            }
+        }
+        if(!reached)
+            break;
+        S.grow(M);
+        if(S.cells.size() <= n)
+            break;
+    }
+    if(monitor) {
+        Residuals::record(cF.fName,ires);
+        Residuals::record(cF.fName,sqrt(sdiv(dx,x2)));
+    }
+    applyExplicitBCs(cF,true,false);
+    /****************************
+     * Iteration info
+     ***************************/
+    if(MP::printOn) {
+        if(symmetric)
+            MP::printH("SYMM-");
+        else
+            MP::printH("ASYM-");
+        MP::print("ACTIVE-PCG :Iterations %d Initial Residual "
+        "%.5e Final Residual %.5e Cells %d\n",iterations,ires,res,
+        (int)S.cells.size());
+    }
+}
 /***************************
  * Explicit instantiations
  ***************************/
@@ -551,6 +1899,12 @@ void Solve(const MeshMatrix<Tensor>& A) {
     SOLVE();
 }
 #undef SOLVE
+void Precondition(const MeshMatrix<Scalar>& A,const ScalarCellField& R,ScalarCellField& Z) {
+    PreconditionT(A,R,Z);
+}
+void Precondition(const MeshMatrix<Vector>& A,const VectorCellField& R,VectorCellField& Z) {
+    PreconditionT(A,R,Z);
+}
 /* ********************
  *        End
  * ********************/
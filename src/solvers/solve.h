@@ -7,5 +7,87 @@ void Solve(const MeshMatrix<Scalar>&);
 void Solve(const MeshMatrix<Vector>&); 
 void Solve(const MeshMatrix<STensor>&); 
 void Solve(const MeshMatrix<Tensor>&); 
+void Precondition(const MeshMatrix<Scalar>&,const ScalarCellField&,ScalarCellField&);
+void Precondition(const MeshMatrix<Vector>&,const VectorCellField&,VectorCellField&);
+
+/**
+ Linear operator and right preconditioner of a system solved by GMRES,
+ acting on flat vectors that are distributed over processors.
+ */
+class KrylovOperator {
+public:
+    virtual ~KrylovOperator() {}
+    /** y = A * x */
+    virtual void mul(const ScalarVector& x,ScalarVector& y) = 0;
+    /** z = inv(P) * v */
+    virtual void precond(const ScalarVector& v,ScalarVector& z) = 0;
+    /** Residual norm compared against the tolerance */
+    virtual Scalar norm(const ScalarVector& r);
+};
+
+Int GMRES(KrylovOperator&,const ScalarVector&,ScalarVector&,Int,Scalar,Int,Scalar&,Scalar&);
+
+/**
+ Largest normalized initial residual and solution change of each 
+ equation over the current outer iteration, used to detect steady state.
+ */
+namespace Residuals {
+    typedef std::map<std::string,Scalar> ResidualMap;
+    extern ResidualMap outer;
+    void record(const std::string&,Scalar);
+}
+
+/**
+ Block-sparse matrix of a coupled system with N unknowns per cell. 
+ Cells and faces hold dense N x N blocks stored row-major, and as in 
+ MeshMatrix the owner row of face k couples to the neighbor through 
+ -an[1][k] and the neighbor row to the owner through -an[0][k].
+ */
+struct BlockMatrix {
+    Int N;                            /**< Block size */
+    std::vector<ScalarCellField*> cF; /**< Solution components X */
+    ScalarVector ap;                  /**< Diagonal blocks */
+    ScalarVector an[2];               /**< Off-diagonal blocks of faces */
+    std::vector<ScalarCellField> Su;  /**< Source components B */
+    
+    BlockMatrix(Int n) : N(n) {
+        cF.assign(N,(ScalarCellField*)0);
+        ap.assign(Mesh::gBCS * N * N,Scalar(0));
+        an[0].assign(Mesh::gFacets.size() * N * N,Scalar(0));
+        an[1].assign(Mesh::gFacets.size() * N * N,Scalar(0));
+        Su.resize(N);
+        for(Int j = 0;j < N;j++)
+            Su[j] = Scalar(0);
+    }
+    Scalar* AP(Int c) {
+        return &ap[c * N * N];
+    }
+    Scalar* AN(Int t,Int k) {
+        return &an[t][k * N * N];
+    }
+};
+
+void Solve(BlockMatrix&);
+
+/**
+ Active region of a localized scalar such as a plume. Cells whose value,
+ or whose source of the current system, exceeds the threshold are grown
+ by a number of halo layers, and the system is solved on those cells
+ only while the rest keep their current values. The set is re-grown
+ and solved again whenever the solution reaches its outer layer.
+ */
+struct ActiveSet {
+    Scalar threshold;                 /**< Activation threshold */
+    Int layers;                       /**< Halo layers around the seed */
+    IntVector cells;                  /**< Active cells, layer by layer */
+    IntVector index;                  /**< Position of a cell in cells, or Int(-1) */
+    Int outer;                        /**< Start of the outermost layer in cells */
+
+    ActiveSet(Scalar t,Int l) : threshold(t), layers(l), outer(0) {
+    }
+    void grow(const MeshMatrix<Scalar>&);
+};
+
+void Solve(const MeshMatrix<Scalar>&,ActiveSet&);
 
 #endif
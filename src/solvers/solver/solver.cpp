@@ -19,6 +19,8 @@ namespace General {
     Scalar P0 = 101325;
     Scalar cp = 1004.67;
     Scalar cv = 715.5;
+    Int low_mach = 0;
+    Scalar mach_cutoff = 0.01;
     
     void enroll(Util::ParamList& params) {
         params.enroll("rho", &density);
@@ -30,6 +32,49 @@ namespace General {
         params.enroll("P0", &P0);
         params.enroll("cp", &cp);
         params.enroll("cv", &cv);
+        Util::Option* op = new Util::BoolOption(&low_mach);
+        params.enroll("low_mach",op);
+        params.enroll("mach_cutoff", &mach_cutoff);
+    }
+    
+    /** 
+    Reference velocity of low Mach preconditioning, bounded below by 
+    the cutoff Mach number and the pressure-difference velocity up 
+    */
+    Scalar lowMachVelocity(Scalar u,Scalar c,Scalar up = 0) {
+        return min(c,max(max(u,up),mach_cutoff * c));
+    }
+}
+
+/**
+parallel-in-time (Parareal) properties
+*/
+namespace Parareal {
+    Int slices = 1;
+    Int coarse_factor = 4;
+    Controls::TimeScheme coarse_scheme = Controls::BDF1;
+    Int max_iterations = 0;
+    Scalar tolerance = 1e-4;
+
+    void enroll(Util::ParamList& params) {
+        params.enroll("slices", &slices);
+        params.enroll("coarse_factor", &coarse_factor);
+        Util::Option* op = new Util::Option(&coarse_scheme,6,
+            "BDF1","BDF2","BDF3","BDF4","BDF5","BDF6");
+        params.enroll("coarse_scheme",op);
+        params.enroll("max_iterations", &max_iterations);
+        params.enroll("tolerance", &tolerance);
+    }
+}
+
+/**
+ensemble properties
+*/
+namespace Ensemble {
+    std::vector<std::string> members;
+
+    void enroll(Util::ParamList& params) {
+        params.enroll("members", &members);
     }
 }
 
@@ -39,10 +84,15 @@ void diffusion(istream&);
 void convection(istream&);
 void potential(istream&);
 void transport(istream&);
+void species(istream&);
 void walldist(istream&);
 void euler(istream&);
 void wave(istream&);
 void hydro_balance(istream&);
+void coupled(istream&);
+void runSolver(string&,istream&);
+void parareal(string&,istream&);
+void ensemble(string&,istream&);
 /**
  \verbatim
  Main application entry point for different solvers.
@@ -90,10 +140,45 @@ int main(int argc, char* argv[]) {
         params.enroll("fields",&BaseField::fieldNames);
         params.read(input);
     }
+    /*Parareal options*/
+    {
+        Util::ParamList params("parareal");
+        Parareal::enroll(params);
+        params.read(input);
+    }
+    /*Ensemble options*/
+    {
+        Util::ParamList params("ensemble");
+        Ensemble::enroll(params);
+        params.read(input);
+    }
     /*cleanup*/
     atexit(MP::cleanup);
 
     /*call solver*/
+    if(Ensemble::members.size())
+        ensemble(sname,input);
+    else if(Parareal::slices > 1 && Controls::state == Controls::TRANSIENT)
+        parareal(sname,input);
+    else
+        runSolver(sname,input);
+    
+#ifdef _DEBUG
+    /*print memory usage*/
+    std::cout << "====================================" << std::endl;
+    std::cout << "Memory Usage:" << std::endl;
+    forEachCellField(printUsage());
+    forEachFacetField(printUsage());
+    forEachVertexField(printUsage());
+    std::cout << "====================================" << std::endl;
+#endif  
+    
+    return 0;
+}
+/**
+ Call solver by name
+*/
+void runSolver(string& sname,istream& input) {
     if (!Util::compare(sname, "piso")) {
         piso(input);
     } else if (!Util::compare(sname, "euler")) {
@@ -104,6 +189,8 @@ int main(int argc, char* argv[]) {
         convection(input);
     } else if (!Util::compare(sname, "transport")) {
         transport(input);
+    } else if (!Util::compare(sname, "species")) {
+        species(input);
     } else if (!Util::compare(sname, "potential")) {
         potential(input);
     } else if (!Util::compare(sname, "hydro_balance")) {
@@ -112,19 +199,9 @@ int main(int argc, char* argv[]) {
         walldist(input);
     } else if (!Util::compare(sname, "wave")) {
         wave(input);
+    } else if (!Util::compare(sname, "coupled")) {
+        coupled(input);
     }
-    
-#ifdef _DEBUG
-    /*print memory usage*/
-    std::cout << "====================================" << std::endl;
-    std::cout << "Memory Usage:" << std::endl;
-    forEachCellField(printUsage());
-    forEachFacetField(printUsage());
-    forEachVertexField(printUsage());
-    std::cout << "====================================" << std::endl;
-#endif  
-    
-    return 0;
 }
 /**
  Iteration object that does common book keeping stuff
@@ -137,6 +214,47 @@ private:
     Int i;
     Int n_deferred;
     Int idf;
+    Int n_converged;
+    
+    /** 
+    Check if outer residuals of all equations and changes of probed 
+    values stayed below steady_tolerance for steady_steps steps 
+    */
+    bool steadyConverged() {
+        using namespace Controls;
+        if(state != STEADY || steady_tolerance <= 0)
+            return false;
+        Scalar res[2];
+        res[0] = 0;
+        res[1] = (Residuals::outer.size() || Mesh::probeCells.size());
+        forEachIt(Residuals::ResidualMap,Residuals::outer,it)
+            res[0] = max(res[0],it->second);
+        forEachCellField(probeChange(res[0]));
+        if(MP::n_hosts > 1) {
+            Scalar global_res[2];
+            MP::allreduce(res,global_res,2,MP::OP_MAX);
+            res[0] = global_res[0];
+            res[1] = global_res[1];
+        }
+        if(MP::printOn) {
+            MP::printH("Outer residuals :");
+            forEachIt(Residuals::ResidualMap,Residuals::outer,it)
+                MP::print(" %s %.5e",it->first.c_str(),it->second);
+            MP::print(" max %.5e\n",res[0]);
+        }
+        Residuals::outer.clear();
+        
+        if(res[1] > 0 && res[0] <= steady_tolerance)
+            n_converged++;
+        else
+            n_converged = 0;
+        if(n_converged >= steady_steps) {
+            if(MP::host_id == 0)
+                MP::printH("Converged at step %d\n",i);
+            return true;
+        }
+        return false;
+    }
 public:
     Iteration(Int step) {
         starti = Controls::write_interval * step + 1;
@@ -145,6 +263,8 @@ public:
         n_deferred = Controls::n_deferred;
         i = starti;
         idf = 0;
+        n_converged = 0;
+        Residuals::outer.clear();
         if(MP::printOn)
             cout << "--------------------------------------------\n";
         Mesh::read_fields(step);
@@ -183,9 +303,14 @@ public:
         /*update time series*/
         forEachCellField(updateTimeSeries(i));
 
-        /*write result to file*/
-        if((i % Controls::write_interval) == 0) {
-            Int step = i / Controls::write_interval;
+        /*skip to the end of this cycle on steady state*/
+        bool converged = steadyConverged();
+        if(converged)
+            i = endi;
+
+        /*write result to file, always when converged*/
+        if(converged || (i % Controls::write_interval) == 0) {
+            Int step = (i + Controls::write_interval - 1) / Controls::write_interval;
             Mesh::write_fields(step);
         }
 
@@ -436,7 +561,7 @@ void piso(istream& input) {
             F = flx(Fc);
             
             /*solve turbulence transport equations*/
-            turb->solve();
+            turb->update();
             
             /*solve energy transport*/
             if (buoyancy != NONE) {
@@ -478,6 +603,248 @@ void piso(istream& input) {
   d(rho*(T))/dt + div(T,F,0) = 0
   \endverbatim
  */
+/**
+  Coupled residual of the euler equations for Jacobian-free Newton-Krylov
+*/
+class EulerSystem {
+public:
+    ScalarCellField& rho;
+    ScalarCellField& T;
+    VectorCellField& U;
+    ScalarCellField& p;
+    ScalarCellField rho0, T0;
+    VectorCellField U0;
+    Scalar p_factor, p_gamma, iPr;
+    Int buoyancy, diffusion;
+    Int N;
+
+    EulerSystem(ScalarCellField& rho_,ScalarCellField& T_,VectorCellField& U_,ScalarCellField& p_) :
+        rho(rho_), T(T_), U(U_), p(p_) {
+        N = Mesh::gBCSfield;
+    }
+    Int size() {
+        return 5 * N;
+    }
+    /*save state of previous time level*/
+    void store() {
+        rho0 = rho;
+        T0 = T;
+        U0 = U;
+    }
+    /*pack and unpack state*/
+    void get(ScalarVector& q) {
+        q.resize(size());
+        for(Int i = 0;i < N;i++) {
+            q[i] = rho[i];
+            q[N + i] = T[i];
+            for(Int j = 0;j < 3;j++)
+                q[(2 + j) * N + i] = U[i][j];
+        }
+    }
+    void set(const ScalarVector& q) {
+        for(Int i = 0;i < N;i++) {
+            rho[i] = q[i];
+            T[i] = q[N + i];
+            for(Int j = 0;j < 3;j++)
+                U[i][j] = q[(2 + j) * N + i];
+        }
+        applyExplicitBCs(rho,true,false);
+        applyExplicitBCs(T,true,false);
+        applyExplicitBCs(U,true,false);
+    }
+    /*residual V * d(q)/dt - R(q) with backward Euler*/
+    void residual(ScalarVector& r) {
+        using namespace Mesh;
+        ScalarFacetField F = flx(rho * U), Fu = flx(U);
+        VectorCellField rhoU = rho * U;
+        ScalarCellField mu, mut;
+        if(diffusion) mu = rho * General::viscosity;
+        else mu = Scalar(0);
+        mut = mu * iPr;
+        p = p_factor * pow(rho * T, p_gamma);
+        VectorCellField Sc = Vector(0);
+        if(buoyancy)
+            Sc += rho * VectorCellField(Controls::gravity);
+        Sc = srcf(Sc) - gradf(p);
+        
+        ScalarCellField Rr = transportf(rho,&U,&Fu);
+        ScalarCellField Rt = transportf(T,&rhoU,&F,&mut);
+        VectorCellField Ru = transportf(U,&rhoU,&F,&mu,&Sc);
+        
+        r.resize(size());
+        for(Int i = 0;i < N;i++) {
+            Scalar m = cV[i] / Controls::dt;
+            r[i] = m * (rho[i] - rho0[i]) - Rr[i];
+            r[N + i] = m * (rho[i] * T[i] - rho0[i] * T0[i]) - Rt[i];
+            for(Int j = 0;j < 3;j++)
+                r[(2 + j) * N + i] = m * (rho[i] * U[i][j] - rho0[i] * U0[i][j]) - Ru[i][j];
+        }
+        
+        /*preconditioned pseudo-time term of steady runs*/
+        if(General::low_mach && Controls::state == Controls::STEADY) {
+            for(Int i = 0;i < N;i++) {
+                Scalar p0 = p_factor * pow(rho0[i] * T0[i], p_gamma);
+                Scalar c2 = p_gamma * p0 / rho0[i];
+                Scalar Ur = General::lowMachVelocity(mag(U0[i]),sqrt(c2));
+                Scalar m = cV[i] / Controls::dt * (1 / (Ur * Ur) - 1 / c2) * (p[i] - p0);
+                r[i] += m;
+                r[N + i] += m * T[i];
+                for(Int j = 0;j < 3;j++)
+                    r[(2 + j) * N + i] += m * U[i][j];
+            }
+        }
+    }
+};
+
+/*global dot product*/
+static Scalar gdot(const ScalarVector& a,const ScalarVector& b) {
+    Scalar s = 0, gs;
+    forEach(a,i)
+        s += a[i] * b[i];
+    MP::allreduce(&s,&gs,1,MP::OP_SUM);
+    return gs;
+}
+
+/**
+  Finite difference Jacobian of the euler residual r at q, right
+  preconditioned by the negated segregated matrices of each equation
+*/
+class EulerJacobian : public KrylovOperator {
+    EulerSystem& sys;
+    const ScalarVector& q;
+    const ScalarVector& r;
+    ScalarCellMatrix& Mr;
+    ScalarCellMatrix& Mt;
+    VectorCellMatrix& Mu;
+    Scalar qnorm;
+    ScalarVector qp, rp;
+    ScalarCellField vs, zs;
+    VectorCellField vv, zv;
+public:
+    EulerJacobian(EulerSystem& sys_,const ScalarVector& q_,const ScalarVector& r_,
+                  ScalarCellMatrix& Mr_,ScalarCellMatrix& Mt_,VectorCellMatrix& Mu_) :
+        sys(sys_), q(q_), r(r_), Mr(Mr_), Mt(Mt_), Mu(Mu_) {
+        qnorm = sqrt(gdot(q,q));
+    }
+    void mul(const ScalarVector& x,ScalarVector& y) {
+        Int n = x.size();
+        Scalar xnorm = sqrt(gdot(x,x));
+        if(xnorm == 0) {
+            y.assign(n,Scalar(0));
+            return;
+        }
+        Scalar eps = sqrt(Scalar(1e-16)) * (1 + qnorm) / xnorm;
+        qp = q;
+        for(Int i = 0;i < n;i++) qp[i] += eps * x[i];
+        sys.set(qp);
+        sys.residual(rp);
+        y.resize(n);
+        for(Int i = 0;i < n;i++) y[i] = (rp[i] - r[i]) / eps;
+    }
+    void precond(const ScalarVector& v,ScalarVector& z) {
+        Int N = sys.N;
+        z.resize(v.size());
+        for(Int i = 0;i < N;i++) vs[i] = -v[i];
+        Precondition(Mr,vs,zs);
+        for(Int i = 0;i < N;i++) z[i] = zs[i];
+        for(Int i = 0;i < N;i++) vs[i] = -v[N + i];
+        Precondition(Mt,vs,zs);
+        for(Int i = 0;i < N;i++) z[N + i] = zs[i];
+        for(Int i = 0;i < N;i++) {
+            for(Int j = 0;j < 3;j++)
+                vv[i][j] = -v[(2 + j) * N + i];
+        }
+        Precondition(Mu,vv,zv);
+        for(Int i = 0;i < N;i++) {
+            for(Int j = 0;j < 3;j++)
+                z[(2 + j) * N + i] = zv[i][j];
+        }
+    }
+};
+
+/**
+  Newton iterations of the coupled euler equations. Each linear system
+  is solved by restarted flexible GMRES with finite difference
+  Jacobian-vector products, right preconditioned by one application of
+  the preconditioner of each segregated matrix. The linear tolerance 
+  tightens as the Newton residual drops, so convergence becomes quadratic
+  near the solution. When GMRES stops above its tolerance, a warning
+  is printed and the Newton step is halved until the residual drops,
+  or the Newton iterations end if it never does.
+*/
+void jfnk(EulerSystem& sys,Int newton_iterations,Scalar newton_tolerance,
+          Int krylov_size,Scalar krylov_tolerance) {
+    using namespace Mesh;
+    Int n = sys.size(), m = krylov_size;
+    ScalarVector q, r, b, dq, qp, rp;
+    Scalar rnorm0 = 0, rprev = 0;
+    
+    sys.store();
+    for(Int it = 0;it < newton_iterations;it++) {
+        sys.get(q);
+        sys.residual(r);
+        Scalar rnorm = sqrt(gdot(r,r));
+        if(it == 0) rnorm0 = rnorm;
+        if(MP::printOn)
+            MP::printH("Newton iteration %d residual %.5e\n",it,rnorm);
+        if(rnorm <= newton_tolerance * rnorm0 || rnorm == 0)
+            break;
+        
+        /*forcing term of Eisenstat and Walker*/
+        Scalar eta = krylov_tolerance;
+        if(it > 0)
+            eta = min(eta,Scalar(0.9) * (rnorm / rprev) * (rnorm / rprev));
+        eta = max(eta,newton_tolerance * rnorm0 / rnorm / 2);
+        rprev = rnorm;
+        
+        /*segregated matrices, whose negative approximates the Jacobian*/
+        ScalarCellMatrix Mr, Mt;
+        VectorCellMatrix Mu;
+        {
+            ScalarFacetField F = flx(sys.rho * sys.U), Fu = flx(sys.U);
+            VectorCellField rhoU = sys.rho * sys.U;
+            ScalarCellField mu;
+            if(sys.diffusion) mu = sys.rho * General::viscosity;
+            else mu = Scalar(0);
+            Mr = convection(sys.rho,sys.U,Fu,Scalar(1));
+            Mt = transport(sys.T,rhoU,F,mu * sys.iPr,Scalar(1),&sys.rho);
+            Mu = transport(sys.U,rhoU,F,mu,Scalar(1),&sys.rho);
+        }
+        
+        /*GMRES(m) for J * dq = -r*/
+        EulerJacobian J(sys,q,r,Mr,Mt,Mu);
+        dq.assign(n,Scalar(0));
+        b.resize(n);
+        for(Int i = 0;i < n;i++) b[i] = -r[i];
+        Scalar beta, ires, tol = eta * rnorm;
+        Int total = GMRES(J,b,dq,m,tol,20 * m,ires,beta);
+        if(MP::printOn)
+            MP::printH("GMRES iterations %d residual %.5e\n",total,beta);
+        
+        /*Newton update, backtracking if GMRES stopped early*/
+        Scalar lambda = 1;
+        if(beta > tol) {
+            bool reduced = false;
+            for(Int ls = 0;ls < 5 && !reduced;ls++) {
+                qp = q;
+                for(Int i = 0;i < n;i++) qp[i] += lambda * dq[i];
+                sys.set(qp);
+                sys.residual(rp);
+                if(sqrt(gdot(rp,rp)) < rnorm) reduced = true;
+                else lambda /= 2;
+            }
+            if(!reduced) lambda = 0;
+            if(MP::host_id == 0)
+                MP::printH("Warning: GMRES stopped at residual %.5e above %.5e,"
+                    " Newton step scaled by %g\n",beta,tol,lambda);
+        }
+        for(Int i = 0;i < n;i++) q[i] += lambda * dq[i];
+        sys.set(q);
+        if(lambda == 0)
+            break;
+    }
+    sys.p = sys.p_factor * pow(sys.rho * sys.T, sys.p_gamma);
+}
 void euler(istream& input) {
     /*Solver specific parameters*/
     Scalar pressure_UR = Scalar(0.5);
@@ -485,6 +852,11 @@ void euler(istream& input) {
     Scalar t_UR = Scalar(0.8);
     Int buoyancy = 1;
     Int diffusion = 1;
+    Int newton = 0;
+    Int newton_iterations = 10;
+    Scalar newton_tolerance = Scalar(1e-8);
+    Int krylov_size = 30;
+    Scalar krylov_tolerance = Scalar(1e-4);
 
     /*transport*/
     Util::ParamList params("euler");
@@ -496,6 +868,12 @@ void euler(istream& input) {
     params.enroll("buoyancy",op);
     op = new Util::BoolOption(&diffusion);
     params.enroll("diffusion",op);
+    op = new Util::BoolOption(&newton);
+    params.enroll("jfnk",op);
+    params.enroll("newton_iterations",&newton_iterations);
+    params.enroll("newton_tolerance",&newton_tolerance);
+    params.enroll("krylov_size",&krylov_size);
+    params.enroll("krylov_tolerance",&krylov_tolerance);
     
     /*read parameters*/
     Util::read_params(input,MP::printOn);
@@ -526,20 +904,60 @@ void euler(istream& input) {
         rho = pow(p / p_factor, 1 / p_gamma) / T;
         Mesh::scaleBCs<Scalar>(p,rho,psi);
         rho.write(0);
+        
+        /*coupled system*/
+        EulerSystem sys(rho,T,U,p);
+        sys.p_factor = p_factor;
+        sys.p_gamma = p_gamma;
+        sys.iPr = iPr;
+        sys.buoyancy = buoyancy;
+        sys.diffusion = diffusion;
     
         /*Time loop*/
         for (; !it.end(); it.next()) {
+            /*Jacobian-free Newton-Krylov*/
+            if(newton) {
+                jfnk(sys,newton_iterations,newton_tolerance,
+                     krylov_size,krylov_tolerance);
+                continue;
+            }
             /*fluxes*/
             F = flx(rho * U);
+            /*artificial viscosity*/
+            if(diffusion) mu = rho * viscosity;
+            else mu = Scalar(0);
+            /*matrix-free explicit step*/
+            if(Controls::matrix_free) {
+                ScalarFacetField Fu = flx(U);
+                VectorCellField rhoU = rho * U;
+                ScalarCellField mut = mu * iPr, level;
+                Scalar h = explicitTimeStep(level,&Fu,&mu,&rho);
+                explicitTransport(rho,&U,&Fu,0,(ScalarCellField*)0,0,&level,h);
+                explicitTransport(T,&rhoU,&F,&mut,(ScalarCellField*)0,&rho,&level,h);
+                p = p_factor * pow(rho * T, p_gamma);
+                VectorCellField Sc = Vector(0);
+                if(buoyancy)
+                    Sc += rho * VectorCellField(Controls::gravity);
+                Sc = srcf(Sc) - gradf(p);
+                explicitTransport(U,&rhoU,&F,&mu,&Sc,&rho,&level,h);
+                continue;
+            }
             /*rho-equation*/
             {
                 ScalarCellMatrix M;
                 M = convection(rho, U, flx(U), pressure_UR);
+                /*preconditioned pseudo-time term of steady runs*/
+                if(low_mach && Controls::state == Controls::STEADY) {
+                    for(Int i = 0;i < Mesh::gBCSfield;i++) {
+                        Scalar c = sqrt(p_gamma * p[i] / rho[i]);
+                        Scalar Ur = lowMachVelocity(mag(U[i]),c);
+                        Scalar k = Mesh::cV[i] / Controls::dt * (c * c / (Ur * Ur) - 1);
+                        M.ap[i] -= k;
+                        M.Su[i] -= k * rho[i];
+                    }
+                }
                 Solve(M);
             }
-            /*artificial viscosity*/
-            if(diffusion) mu = rho * viscosity;
-            else mu = Scalar(0);
             /*T-equation*/
             {
                 ScalarCellMatrix M,Mt;
@@ -565,6 +983,389 @@ void euler(istream& input) {
         }
     }
 }
+/* *****************************************
+ * Inviscid fluxes of the euler equations
+ * *****************************************/
+
+/** Primitive state of the compressible euler equations */
+struct EulerState {
+    Scalar rho, p, H, c;
+    Vector u;
+    EulerState() {}
+    EulerState(Scalar rho_,const Vector& u_,Scalar p_,Scalar gamma) :
+        rho(rho_), p(p_), u(u_) {
+        c = sqrt(gamma * p / rho);
+        H = c * c / (gamma - 1) + (u & u) / 2;
+    }
+    void conserved(Scalar* Q) const {
+        Q[0] = rho;
+        for(Int i = 0;i < 3;i++)
+            Q[1 + i] = rho * u[i];
+        Q[4] = rho * H - p;
+    }
+};
+
+/** Inviscid flux through area vector S */
+static void eulerFlux(const EulerState& q,const Vector& S,Scalar* F) {
+    Scalar un = q.u & S;
+    F[0] = q.rho * un;
+    for(Int i = 0;i < 3;i++)
+        F[1 + i] = q.rho * q.u[i] * un + q.p * S[i];
+    F[4] = q.rho * q.H * un;
+}
+
+/** Jacobian of the inviscid flux through S with respect to the conserved variables */
+static void eulerJacobian(const EulerState& q,const Vector& S,Scalar gamma,Scalar* A) {
+    const Int N = 5;
+    Scalar g1 = gamma - 1;
+    Scalar un = q.u & S;
+    Scalar phi = g1 * (q.u & q.u) / 2;
+    A[0] = 0;
+    for(Int j = 0;j < 3;j++)
+        A[1 + j] = S[j];
+    A[4] = 0;
+    for(Int i = 0;i < 3;i++) {
+        Scalar* a = &A[(1 + i) * N];
+        a[0] = phi * S[i] - q.u[i] * un;
+        for(Int j = 0;j < 3;j++)
+            a[1 + j] = q.u[i] * S[j] - g1 * S[i] * q.u[j] + ((i == j) ? un : 0);
+        a[4] = g1 * S[i];
+    }
+    Scalar* a = &A[4 * N];
+    a[0] = un * (phi - q.H);
+    for(Int j = 0;j < 3;j++)
+        a[1 + j] = q.H * S[j] - g1 * q.u[j] * un;
+    a[4] = gamma * un;
+}
+
+/**
+Weiss-Smith preconditioning matrix of low Mach flows transformed to 
+conserved variables. It differs from identity only in the pressure
+derivative, which is scaled to propagate sound at the reference velocity.
+*/
+static void lowMachMatrix(const EulerState& q,Scalar gamma,Scalar up,Scalar* G) {
+    const Int N = 5;
+    Scalar Ur = General::lowMachVelocity(mag(q.u),q.c,up);
+    Scalar d = 1 / (Ur * Ur) - 1 / (q.c * q.c);
+    Scalar g1 = gamma - 1;
+    Scalar e[N] = {1, q.u[0], q.u[1], q.u[2], q.H};
+    Scalar r[N] = {g1 * (q.u & q.u) / 2, -g1 * q.u[0], -g1 * q.u[1], -g1 * q.u[2], g1};
+    for(Int i = 0;i < N;i++) {
+        for(Int j = 0;j < N;j++)
+            G[i * N + j] = d * e[i] * r[j] + ((i == j) ? 1 : 0);
+    }
+}
+
+/** Largest wave speed of the preconditioned system in direction n */
+static Scalar lowMachSpeed(const EulerState& q,const Vector& n,Scalar up) {
+    Scalar Ur = General::lowMachVelocity(mag(q.u),q.c,up);
+    Scalar un = q.u & n;
+    Scalar alpha = (1 - (Ur * Ur) / (q.c * q.c)) / 2;
+    return fabs(un * (1 - alpha)) + sqrt(alpha * alpha * un * un + Ur * Ur);
+}
+
+/**
+Numerical flux of Rusanov or of Roe with Harten's entropy fix through
+area vector S. Given a preconditioning matrix G, the Rusanov dissipation
+is scaled with the preconditioned wave speeds instead. Returns the largest
+wave speed at the face.
+*/
+static Scalar riemannFlux(const EulerState& L,const EulerState& R,const Vector& S,
+                          Scalar gamma,bool roe,Scalar* F,const Scalar* G = 0,Scalar up = 0) {
+    const Int N = 5;
+    Scalar FL[N], FR[N];
+    Scalar area = mag(S);
+    Vector n = S / area;
+    eulerFlux(L,S,FL);
+    eulerFlux(R,S,FR);
+    Scalar lam = std::max(fabs(L.u & n) + L.c,fabs(R.u & n) + R.c);
+    for(Int i = 0;i < N;i++)
+        F[i] = (FL[i] + FR[i]) / 2;
+    if(!roe || G) {
+        Scalar QL[N], QR[N], dQ[N];
+        L.conserved(QL);
+        R.conserved(QR);
+        for(Int i = 0;i < N;i++)
+            dQ[i] = QR[i] - QL[i];
+        if(G) {
+            lam = std::max(lowMachSpeed(L,n,up),lowMachSpeed(R,n,up));
+            for(Int i = 0;i < N;i++) {
+                Scalar s = 0;
+                for(Int j = 0;j < N;j++)
+                    s += G[i * N + j] * dQ[j];
+                F[i] -= lam * area * s / 2;
+            }
+        } else {
+            for(Int i = 0;i < N;i++)
+                F[i] -= lam * area * dQ[i] / 2;
+        }
+        return lam;
+    }
+    /*Roe averages*/
+    Scalar r = sqrt(R.rho / L.rho);
+    Scalar rho = sqrt(L.rho * R.rho);
+    Vector u = (L.u + r * R.u) / (1 + r);
+    Scalar H = (L.H + r * R.H) / (1 + r);
+    Scalar q2 = u & u;
+    Scalar c = sqrt((gamma - 1) * (H - q2 / 2));
+    Scalar V = u & n;
+    /*jumps*/
+    Scalar dp = R.p - L.p, drho = R.rho - L.rho;
+    Vector du = R.u - L.u;
+    Scalar dV = du & n;
+    /*eigenvalues with entropy fix*/
+    Scalar l[3] = {fabs(V - c), fabs(V), fabs(V + c)};
+    Scalar delta = c / 10;
+    for(Int i = 0;i < 3;i++) {
+        if(l[i] < delta)
+            l[i] = (l[i] * l[i] + delta * delta) / (2 * delta);
+    }
+    /*wave strengths*/
+    Scalar a1 = l[0] * (dp - rho * c * dV) / (2 * c * c);
+    Scalar a5 = l[2] * (dp + rho * c * dV) / (2 * c * c);
+    Scalar a2 = l[1] * (drho - dp / (c * c));
+    Scalar a3 = l[1] * rho;
+    Scalar D[N];
+    D[0] = a1 + a2 + a5;
+    for(Int i = 0;i < 3;i++)
+        D[1 + i] = a1 * (u[i] - c * n[i]) + a2 * u[i] + 
+                   a3 * (du[i] - dV * n[i]) + a5 * (u[i] + c * n[i]);
+    D[4] = a1 * (H - c * V) + a2 * q2 / 2 + 
+           a3 * ((u & du) - V * dV) + a5 * (H + c * V);
+    for(Int i = 0;i < N;i++)
+        F[i] -= area * D[i] / 2;
+    return lam;
+}
+/**
+  \verbatim
+  Coupled density-based solver
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Solves the compressible euler equations for the conserved variables 
+  Q = (rho, rho*U, rho*E) simultaneously, 
+       V * dQ/dt + sum(F(Q)) = 0
+  with backward Euler time stepping. Face fluxes come from the Roe or 
+  Rusanov approximate Riemann solvers. The linearized system with 5x5 
+  blocks is solved each step with block-preconditioned GMRES. Steady
+  runs with CFL > 0 use local time steps.
+  \endverbatim
+ */
+void coupled(istream& input) {
+    /*Solver specific parameters*/
+    Int riemann_solver = 1;
+    Int inner_iterations = 5;
+
+    /*coupled*/
+    Util::ParamList params("coupled");
+    Util::Option* op;
+    op = new Util::Option(&riemann_solver,2,"RUSANOV","ROE");
+    params.enroll("riemann_solver",op);
+    params.enroll("inner_iterations",&inner_iterations);
+    
+    /*read parameters*/
+    Util::read_params(input,MP::printOn);
+    
+    if(DG::NPMAT) {
+        if(MP::printOn)
+            MP::printH("Coupled solver supports finite volume only.\n");
+        return;
+    }
+    
+    /*AMR iteration*/
+    for (AmrIteration ait; !ait.end(); ait.next()) {
+        
+        ScalarCellField p("p",READWRITE);
+        VectorCellField U("U",READWRITE);
+        ScalarCellField T("T",READWRITE);
+        ScalarCellField rho("rho",WRITE);
+        
+        /*Read fields*/
+        Iteration it(ait.get_step());
+        
+        /*gas constants*/
+        using namespace General;
+        using namespace Mesh;
+        const Int N = 5;
+        Scalar R = cp - cv;
+        Scalar gamma = cp / cv;
+        rho = p / (R * T);
+        
+        /*faces on processor boundaries*/
+        std::vector<bool> pface(gFacets.size(),false);
+        forEach(gInterMesh,i) {
+            IntVector& f = *(gInterMesh[i].f);
+            forEach(f,j)
+                pface[f[j]] = true;
+        }
+        
+        /*preconditioned transient runs use dual time stepping*/
+        bool dual = low_mach && (Controls::state != Controls::STEADY);
+        Int n_inner = dual ? inner_iterations : 1;
+        
+        /*unsteady cutoff of reference velocity, L / (pi * dt)*/
+        ScalarCellField ut = Scalar(0);
+        if(dual) {
+            forEach(gFacets,k) {
+                Scalar a = mag(fN[k]);
+                ut[gFOC[k]] += a;
+                if(gFNC[k] < gBCS) ut[gFNC[k]] += a;
+            }
+            for(Int c = 0;c < gBCS;c++)
+                ut[c] = 2 * cV[c] / (ut[c] * Constants::PI * Controls::dt);
+        }
+        
+        /*Time loop*/
+        for (; !it.end(); it.next()) {
+            
+            /*conserved variables of previous time level*/
+            std::vector<Scalar> Qn;
+            if(dual) {
+                Qn.resize(N * gBCS);
+                for(Int c = 0;c < gBCS;c++)
+                    EulerState(rho[c],U[c],p[c],gamma).conserved(&Qn[c * N]);
+            }
+            
+            for(Int inner = 0;inner < n_inner;inner++) {
+                BlockMatrix M(N);
+                ScalarCellField dQ[N], sr;
+                for(Int j = 0;j < N;j++) {
+                    dQ[j] = Scalar(0);
+                    M.cF[j] = &dQ[j];
+                }
+                sr = Scalar(0);
+                
+                /*states*/
+                std::vector<EulerState> q(rho.size());
+                forEach(q,i)
+                    q[i] = EulerState(rho[i],U[i],p[i],gamma);
+                
+                /*fluxes and their jacobians*/
+                Scalar F[N], AL[N * N], AR[N * N], G[N * N];
+                Scalar* pG = low_mach ? G : 0;
+                ScalarCellField up = ut;
+                forEach(gFacets,k) {
+                    Int c1 = gFOC[k];
+                    Int c2 = gFNC[k];
+                    const Vector& S = fN[k];
+                    Scalar upf = 0;
+                    if(pG) {
+                        EulerState qf((q[c1].rho + q[c2].rho) / 2,(q[c1].u + q[c2].u) / 2,
+                                      (q[c1].p + q[c2].p) / 2,gamma);
+                        upf = max(ut[c1],sqrt(fabs(q[c2].p - q[c1].p) / qf.rho));
+                        up[c1] = max(up[c1],upf);
+                        up[c2] = max(up[c2],upf);
+                        lowMachMatrix(qf,gamma,upf,G);
+                    }
+                    Scalar sa = riemannFlux(q[c1],q[c2],S,gamma,riemann_solver == 1,F,pG,upf) * mag(S);
+                    eulerJacobian(q[c1],S,gamma,AL);
+                    eulerJacobian(q[c2],S,gamma,AR);
+                    for(Int i = 0;i < N;i++) {
+                        for(Int j = 0;j < N;j++) {
+                            Scalar d = pG ? sa * G[i * N + j] : ((i == j) ? sa : 0);
+                            AL[i * N + j] += d;
+                            AR[i * N + j] -= d;
+                        }
+                    }
+                    for(Int i = 0;i < N * N;i++) {
+                        AL[i] /= 2;
+                        AR[i] /= 2;
+                    }
+                    
+                    Scalar* ap1 = M.AP(c1);
+                    for(Int i = 0;i < N;i++)
+                        M.Su[i][c1] -= F[i];
+                    for(Int i = 0;i < N * N;i++)
+                        ap1[i] += AL[i];
+                    sr[c1] += sa;
+                    if(c2 < gBCS) {
+                        Scalar* ap2 = M.AP(c2);
+                        Scalar* an0 = M.AN(0,k);
+                        Scalar* an1 = M.AN(1,k);
+                        for(Int i = 0;i < N;i++)
+                            M.Su[i][c2] += F[i];
+                        for(Int i = 0;i < N * N;i++) {
+                            ap2[i] -= AR[i];
+                            an0[i] = AL[i];
+                            an1[i] = -AR[i];
+                        }
+                        sr[c2] += sa;
+                    } else if(pface[k]) {
+                        Scalar* an1 = M.AN(1,k);
+                        for(Int i = 0;i < N * N;i++)
+                            an1[i] = -AR[i];
+                    }
+                }
+                
+                /*pseudo time step*/
+                ScalarCellField idt;
+                if(Controls::CFL > 0) {
+                    idt = sr / (Controls::CFL * cV);
+                    if(Controls::state != Controls::STEADY && !dual) {
+                        Scalar m = 0, gm;
+                        for(Int i = 0;i < gBCS;i++)
+                            m = std::max(m,idt[i]);
+                        MP::allreduce(&m,&gm,1,MP::OP_MAX);
+                        idt = gm;
+                        Controls::dt = 1 / gm;
+                    }
+                } else 
+                    idt = 1 / Controls::dt;
+                for(Int c = 0;c < gBCS;c++) {
+                    Scalar* a = M.AP(c);
+                    Scalar m = cV[c] * idt[c];
+                    if(pG) {
+                        lowMachMatrix(q[c],gamma,up[c],G);
+                        for(Int i = 0;i < N * N;i++)
+                            a[i] += m * G[i];
+                    } else {
+                        for(Int i = 0;i < N;i++)
+                            a[i * N + i] += m;
+                    }
+                }
+                
+                /*physical time derivative*/
+                if(dual) {
+                    Scalar Q[N];
+                    for(Int c = 0;c < gBCS;c++) {
+                        Scalar* a = M.AP(c);
+                        Scalar m = cV[c] / Controls::dt;
+                        q[c].conserved(Q);
+                        for(Int i = 0;i < N;i++) {
+                            a[i * N + i] += m;
+                            M.Su[i][c] -= m * (Q[i] - Qn[c * N + i]);
+                        }
+                    }
+                }
+                Scalar res = 0;
+                for(Int c = 0;c < gBCS;c++)
+                    res += M.Su[0][c] * M.Su[0][c];
+                
+                /*solve*/
+                Solve(M);
+                
+                /*update conserved variables*/
+                for(Int c = 0;c < gBCS;c++) {
+                    Scalar r = rho[c] + dQ[0][c];
+                    Vector ru = rho[c] * U[c] + Vector(dQ[1][c],dQ[2][c],dQ[3][c]);
+                    Scalar rE = rho[c] * q[c].H - p[c] + dQ[4][c];
+                    rho[c] = r;
+                    U[c] = ru / r;
+                    p[c] = (gamma - 1) * (rE - (ru & U[c]) / 2);
+                    T[c] = p[c] / (r * R);
+                }
+                applyExplicitBCs(p,true,false);
+                applyExplicitBCs(U,true,false);
+                applyExplicitBCs(T,true,false);
+                rho = p / (R * T);
+                
+                /*density residual*/
+                Scalar gres;
+                MP::allreduce(&res,&gres,1,MP::OP_SUM);
+                if(MP::printOn)
+                    MP::printH("Density residual %.5e\n",sqrt(gres));
+            }
+        }
+    }
+}
 /**
   \verbatim
   Convection solver
@@ -577,10 +1378,14 @@ void euler(istream& input) {
 void convection(istream& input) {
     /*Solver specific parameters*/
     Scalar t_UR = Scalar(1);
+    Scalar active_threshold = Scalar(0);
+    Int active_layers = 2;
 
     /*transport*/
     Util::ParamList params("convection");
     params.enroll("t_UR", &t_UR);
+    params.enroll("active_threshold", &active_threshold);
+    params.enroll("active_layers", &active_layers);
 
     /*read parameters*/
     Util::read_params(input,MP::printOn);
@@ -594,10 +1399,17 @@ void convection(istream& input) {
         /*Time loop*/
         Iteration it(ait.get_step());
         ScalarFacetField F = flx(U);
+        ActiveSet active(active_threshold,active_layers);
         for (; !it.end(); it.next()) {
+            if(Controls::matrix_free) {
+                ScalarCellField level;
+                Scalar h = explicitTimeStep(level,&F);
+                explicitTransport(T,&U,&F,0,(ScalarCellField*)0,0,&level,h);
+                continue;
+            }
             ScalarCellMatrix M;
             M = convection(T, U, F, t_UR);
-            Solve(M);
+            Solve(M,active);
         }
     }
 }
@@ -630,12 +1442,36 @@ void diffusion(istream& input) {
         /*Time loop*/
         ScalarCellField mu = DT;
         for (Iteration it(ait.get_step()); !it.end(); it.next()) {
+            if(Controls::matrix_free) {
+                ScalarCellField level;
+                Scalar h = explicitTimeStep(level,0,&mu);
+                explicitTransport(T,0,0,&mu,(ScalarCellField*)0,0,&level,h);
+                continue;
+            }
             ScalarCellMatrix M;
             M = diffusion(T, mu, t_UR);
             Solve(M);
         }
     }
 }
+/**
+ Parameters of the transport solver
+ */
+struct TransportParams {
+    Scalar DT;
+    Scalar t_UR;
+    Scalar active_threshold;
+    Int active_layers;
+
+    TransportParams() : DT(1.0e-4), t_UR(1), active_threshold(0), active_layers(2) {
+    }
+    void enroll(Util::ParamList& params) {
+        params.enroll("t_UR", &t_UR);
+        params.enroll("DT", &DT);
+        params.enroll("active_threshold", &active_threshold);
+        params.enroll("active_layers", &active_layers);
+    }
+};
 /**
   \verbatim
   Transport equation solver
@@ -647,11 +1483,130 @@ void diffusion(istream& input) {
  */
 void transport(istream& input) {
     /*Solver specific parameters*/
-    Scalar DT = Scalar(1.0e-4);
-    Scalar t_UR = Scalar(1);
+    TransportParams tp;
 
     /*transport*/
     Util::ParamList params("transport");
+    tp.enroll(params);
+
+    /*read parameters*/
+    Util::read_params(input,MP::printOn);
+    
+    /*AMR iteration*/
+    for (AmrIteration ait; !ait.end(); ait.next()) {
+        
+        VectorCellField U("U", READWRITE);
+        ScalarCellField T("T", READWRITE);
+        
+        /*Time loop*/
+        Iteration it(ait.get_step());
+        ScalarFacetField F = flx(U);
+        ScalarCellField mu = tp.DT;
+        ActiveSet active(tp.active_threshold,tp.active_layers);
+        for (; !it.end(); it.next()) {
+            if(Controls::matrix_free) {
+                ScalarCellField level;
+                Scalar h = explicitTimeStep(level,&F,&mu);
+                explicitTransport(T,&U,&F,&mu,(ScalarCellField*)0,0,&level,h);
+                continue;
+            }
+            ScalarCellMatrix M;
+            M = transport(T, U, F, mu, tp.t_UR);
+            Solve(M,active);
+        }
+    }
+}
+/** Get the boundary conditions of a scalar field by boundary name */
+static void getBCs(const ScalarCellField& cF,BConditionMap& bcs) {
+    using namespace Mesh;
+    bcs.clear();
+    forEach(AllBConditions,i) {
+        BasicBCondition* bbc = AllBConditions[i];
+        if(bbc->fIndex == cF.fIndex && bbc->cIndex != GHOST)
+            bcs[bbc->bname] = static_cast<BCondition<Scalar>*>(bbc);
+    }
+}
+/** 
+ Check if boundary conditions of two scalars lead to the same 
+ matrix coefficients
+ */
+static bool sameBCs(BConditionMap& a,BConditionMap& b) {
+    using namespace Mesh;
+    if(a.size() != b.size())
+        return false;
+    forEachIt(BConditionMap,a,it) {
+        BConditionMap::iterator it2 = b.find(it->first);
+        if(it2 == b.end())
+            return false;
+        BCondition<Scalar>* bc1 = it->second;
+        BCondition<Scalar>* bc2 = it2->second;
+        if(bc1->cIndex != bc2->cIndex)
+            return false;
+        if(bc1->cIndex == ROBIN && !equal(bc1->shape,bc2->shape))
+            return false;
+    }
+    return true;
+}
+/**
+ Batch of scalars packed into the components of a vector field
+ */
+struct ScalarBatch {
+    std::vector<ScalarCellField*> cF;
+    VectorCellField* T;
+
+    /** Copy values of all cells, including ghost cells, into the batch */
+    void pack() {
+        VectorCellField& t = *T;
+        forEach(t,i) {
+            forEach(cF,j)
+                t[i][j] = (*cF[j])[i];
+        }
+    }
+    /** Copy solution back to the scalars and update their boundaries */
+    void unpack() {
+        VectorCellField& t = *T;
+        for(Int i = 0;i < Mesh::gBCSfield;i++) {
+            forEach(cF,j)
+                (*cF[j])[i] = t[i][j];
+        }
+        forEach(cF,j)
+            applyExplicitBCs(*cF[j],true,false);
+        pack();
+    }
+    /**
+     Apply implicit boundary conditions of the scalars. The coefficients
+     are changed once for all, while the sources get the boundary 
+     values of each scalar from the ghost cells of the batch.
+     */
+    void applyImplicitBCs(VectorCellMatrix& M) {
+        std::vector<BConditionMap> bcs(cF.size());
+        forEach(cF,j)
+            getBCs(*cF[j],bcs[j]);
+        ::applyImplicitBCs(M,&bcs);
+    }
+};
+/**
+  \verbatim
+  Multi-scalar transport solver
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Transports several passive scalars with the same diffusivity
+     dT/dt + div(T,F,DT) = lap(T,DT)
+  Scalars with the same types of boundary conditions are packed into 
+  the three components of a vector field. The coefficients of a batch are 
+  assembled once, and its scalars are solved together with one 
+  matrix-vector product per iteration. The sources and boundary values 
+  stay separate for each scalar.
+  \endverbatim
+ */
+void species(istream& input) {
+    /*Solver specific parameters*/
+    std::vector<std::string> names;
+    Scalar DT = Scalar(1.0e-4);
+    Scalar t_UR = Scalar(1);
+
+    /*species*/
+    Util::ParamList params("species");
+    params.enroll("scalars", &names);
     params.enroll("t_UR", &t_UR);
     params.enroll("DT", &DT);
 
@@ -662,17 +1617,71 @@ void transport(istream& input) {
     for (AmrIteration ait; !ait.end(); ait.next()) {
         
         VectorCellField U("U", READWRITE);
-        ScalarCellField T("T", READWRITE);
+        std::vector<ScalarCellField*> cF(names.size());
+        forEach(names,j)
+            cF[j] = new ScalarCellField(names[j].c_str(), READWRITE);
         
         /*Time loop*/
         Iteration it(ait.get_step());
         ScalarFacetField F = flx(U);
         ScalarCellField mu = DT;
+
+        /*batches of scalars with the same types of boundary conditions*/
+        const Int N = sizeof(Vector) / sizeof(Scalar);
+        std::vector<ScalarBatch> batches;
+        std::vector<bool> batched(cF.size(),false);
+        forEach(cF,j) {
+            if(batched[j]) continue;
+            ScalarBatch b;
+            BConditionMap bcj,bcl;
+            getBCs(*cF[j],bcj);
+            for(Int l = j;l < cF.size() && b.cF.size() < N;l++) {
+                if(batched[l]) continue;
+                getBCs(*cF[l],bcl);
+                if(sameBCs(bcj,bcl)) {
+                    b.cF.push_back(cF[l]);
+                    batched[l] = true;
+                }
+            }
+            b.T = 0;
+            if(b.cF.size() > 1) {
+                stringstream name;
+                name << "species" << batches.size();
+                b.T = new VectorCellField(name.str().c_str());
+                *b.T = Vector(0);
+                b.pack();
+            }
+            batches.push_back(b);
+        }
+        
         for (; !it.end(); it.next()) {
-            ScalarCellMatrix M;
-            M = transport(T, U, F, mu, t_UR);
-            Solve(M);
+            if(Controls::matrix_free) {
+                ScalarCellField level;
+                Scalar h = explicitTimeStep(level,&F,&mu);
+                forEach(cF,j)
+                    explicitTransport(*cF[j],&U,&F,&mu,(ScalarCellField*)0,0,&level,h);
+                continue;
+            }
+            forEach(batches,k) {
+                ScalarBatch& b = batches[k];
+                if(b.T) {
+                    VectorCellMatrix M;
+                    M = transport(*b.T, U, F, mu, t_UR);
+                    b.applyImplicitBCs(M);
+                    Solve(M);
+                    b.unpack();
+                } else {
+                    ScalarCellMatrix M;
+                    M = transport(*b.cF[0], U, F, mu, t_UR);
+                    Solve(M);
+                }
+            }
         }
+        
+        forEach(batches,k)
+            delete batches[k].T;
+        forEach(cF,j)
+            delete cF[j];
     }
 }
 /**
@@ -848,7 +1857,8 @@ void walldist(istream& input) {
 Calculate wall distance at given time step
 */
 void Mesh::calc_walldist(Int step, Int n_ORTHO) {
-    ScalarCellField& phi = yWall;
+    ScalarCellField phi;
+    phi = yWall;
     /*poisson equation*/
     {
         const ScalarCellField one = Scalar(1);
@@ -858,8 +1868,546 @@ void Mesh::calc_walldist(Int step, Int n_ORTHO) {
     /*wall distance*/
     {
         const VectorCellField g = gradi(phi);
-        yWall = sqrt((g & g) + 2 * phi) - mag(g);
+        phi = sqrt((g & g) + 2 * phi) - mag(g);
     }
     /*write it*/
-    yWall.write(step);
-}
\ No newline at end of file
+    phi.write(step);
+    yWall = phi;
+}
+/**
+ Copy file
+ */
+static bool copyFile(const string& src,const string& dst) {
+    ifstream is(src.c_str(),ios::binary);
+    if(is.fail())
+        return false;
+    ofstream os(dst.c_str(),ios::binary);
+    os << is.rdbuf();
+    return true;
+}
+/**
+ Copy the mesh, and the last refined mesh at a write step, into dir
+ */
+static void copyMesh(const string& dir,Int step) {
+    copyFile(Mesh::gMeshName,dir + "/" + Mesh::gMeshName);
+    for(int n = step;n >= 0;n--) {
+        stringstream path;
+        path << Mesh::gMeshName << "_" << n;
+        if(copyFile(path.str(),dir + "/" + path.str()))
+            break;
+    }
+}
+/** Path of field file at a write step */
+static string fieldPath(const string& dir,const string& name,Int step) {
+    stringstream path;
+    path << dir << "/" << name << step;
+    return path.str();
+}
+/** 
+ Run the solver inside dir with the processes of the current group,
+ and merge the decomposed fields written after write step n0 up to n1 
+ */
+static void solveInDir(string& sname,istream& input,const string& dir,
+                       Int n0,Int n1) {
+    string cwd = MP::workingDir;
+    
+    /*solve*/
+    System::cd(dir);
+    System::pwd(MP::workingDir,PATH_MAX + 1);
+    runSolver(sname,input);
+    System::cd(MP::workingDir);
+    
+    /*merge decomposed fields*/
+    if(MP::n_hosts > 1) {
+        MP::barrier();
+        if(MP::host_id == 0) {
+            for(Int n = n0 + 1;n <= n1;n++)
+                Prepare::mergeFields(n,n0);
+        }
+        MP::barrier();
+    }
+    System::cd(cwd);
+    System::pwd(MP::workingDir,PATH_MAX + 1);
+}
+/**
+ \verbatim
+ Parareal driver
+ ~~~~~~~~~~~~~~~
+ References:
+    J.-L. Lions, Y. Maday and G. Turinici, "A parareal in time 
+    discretization of PDEs".
+ Description:
+    The time interval is split into slices each of which is solved
+    concurrently by a group of processes using the fine propagator F,
+    i.e. the solver with the user given controls. The initial states of 
+    the slices are corrected sequentially with a cheap coarse propagator G,
+    which takes coarse_factor times larger time steps with coarse_scheme,
+        U(s+1) = G(U'(s)) + F(U(s)) - G(U(s))
+    where U' is the corrected state. The iterations stop when the correction 
+    falls below tolerance, or at the latest after all slices are exact.
+    Each slice runs in its own directory slice<s>, and the coarse 
+    propagator in directory coarse. The fine results are copied back to 
+    the working directory at the end.
+ \endverbatim
+*/
+namespace Parareal {
+    /** Internal values of a field file along with its header and boundaries */
+    struct FieldFile {
+        string size;
+        ScalarVector values;
+        string boundary;
+
+        bool read(const string& name) {
+            ifstream is(name.c_str());
+            if(is.fail())
+                return false;
+            Int count,dim;
+            string str;
+            getline(is,size);
+            stringstream ss(size);
+            ss >> str >> dim;
+            is >> count >> str;
+            values.resize(count * dim);
+            forEach(values,i)
+                is >> values[i];
+            is >> str;
+            stringstream rest;
+            rest << is.rdbuf();
+            boundary = rest.str();
+            return true;
+        }
+        void write(const string& name) {
+            ofstream os(name.c_str());
+            stringstream ss(size);
+            string str;
+            Int dim;
+            ss >> str >> dim;
+            os << size << endl;
+            os << values.size() / dim << endl;
+            os << "{" << endl;
+            for(Int i = 0;i < values.size();i += dim) {
+                for(Int j = 0;j < dim;j++)
+                    os << values[i + j] << " ";
+                os << endl;
+            }
+            os << "}";
+            os << boundary;
+        }
+    };
+    /** 
+    Run the fine or coarse propagator from write step n0 to n1
+    inside dir with the processes of the current group 
+    */
+    void propagate(string& sname,istream& input,const string& dir,
+                   Int n0,Int n1,bool coarse) {
+        using namespace Controls;
+        
+        /*save controls*/
+        Scalar dt0 = dt;
+        Int write_interval0 = write_interval;
+        Int start_step0 = start_step;
+        Int end_step0 = end_step;
+        Int amr_step0 = amr_step;
+        TimeScheme time_scheme0 = time_scheme;
+        
+        /*coarse controls*/
+        if(coarse) {
+            Int m = max(coarse_factor,1);
+            while(write_interval % m) m--;
+            dt *= m;
+            write_interval /= m;
+            time_scheme = coarse_scheme;
+        }
+        start_step = n0 * write_interval;
+        end_step = n1 * write_interval;
+        amr_step = 0;
+        
+        /*solve*/
+        solveInDir(sname,input,dir,n0,n1);
+        
+        /*restore controls*/
+        dt = dt0;
+        write_interval = write_interval0;
+        start_step = start_step0;
+        end_step = end_step0;
+        amr_step = amr_step0;
+        time_scheme = time_scheme0;
+    }
+    /** 
+    Correct state of fields at step n as U = G + F - G0, and return
+    relative change with respect to old state in dst
+    */
+    Scalar correct(const string& G,const string& F,const string& G0,
+                   const string& dst,Int n) {
+        vector<string>& fields = BaseField::fieldNames;
+        Scalar diff = 0;
+        forEach(fields,i) {
+            FieldFile u,f,g0,uold;
+            if(!f.read(fieldPath(F,fields[i],n)))
+                continue;
+            if(G.empty()) {
+                u = f;
+            } else {
+                u.read(fieldPath(G,fields[i],n));
+                g0.read(fieldPath(G0,fields[i],n));
+                forEach(u.values,j)
+                    u.values[j] += f.values[j] - g0.values[j];
+            }
+            if(uold.read(fieldPath(dst,fields[i],n))) {
+                Scalar sum = 0,sumd = 0;
+                forEach(u.values,j) {
+                    sum += u.values[j] * u.values[j];
+                    sumd += pow(u.values[j] - uold.values[j],2);
+                }
+                diff = max(diff,sqrt(sumd / max(sum,Constants::MachineEpsilon)));
+            }
+            u.write(fieldPath(dst,fields[i],n));
+        }
+        return diff;
+    }
+}
+/**
+ Solve transient problem with Parareal
+ */
+void parareal(string& sname,istream& input) {
+    using namespace Parareal;
+    using namespace Controls;
+    
+    vector<string>& fields = BaseField::fieldNames;
+    Int world_size = MP::n_hosts;
+    Int world_id = MP::host_id;
+    
+    /*time slices*/
+    Int N0 = start_step / write_interval;
+    Int N1 = end_step / write_interval;
+    Int S = (N1 > N0) ? min(min(slices,world_size),N1 - N0) : 0;
+    
+    /*nothing to parallelize in time*/
+    if(S <= 1) {
+        runSolver(sname,input);
+        return;
+    }
+    
+    IntVector ns(S + 1);
+    for(Int s = 0;s < S;s++)
+        ns[s] = N0 + s * ((N1 - N0) / S);
+    ns[S] = N1;
+    
+    vector<string> dirs(S);
+    for(Int s = 0;s < S;s++) {
+        stringstream path;
+        path << "slice" << s;
+        dirs[s] = path.str();
+    }
+    const string cdir = "coarse";
+    const string odir = "coarse/old";
+    
+    /*setup directories*/
+    if(world_id == 0) {
+        MP::printH("Parareal with %d slices\n",S);
+        for(int s = -1;s < int(S);s++) {
+            const string& dir = (s < 0) ? cdir : dirs[s];
+            System::mkdir(dir);
+            copyMesh(dir,N0);
+            if(s <= 0) {
+                forEach(fields,i)
+                    copyFile(fieldPath(".",fields[i],N0),
+                             fieldPath(dir,fields[i],N0));
+            }
+        }
+        System::mkdir(odir);
+    }
+    MP::barrier();
+    
+    /*each slice is solved by its own group of processes*/
+    Int group = world_id * S / world_size;
+    if(group > 0) {
+        string log = dirs[group] + "/log";
+        if(!freopen(log.c_str(),"w",stdout))
+            MP::printH("Failed to redirect output to %s\n",log.c_str());
+    }
+    
+    /*initial coarse solution*/
+    MP::split(group);
+    if(group == 0) {
+        propagate(sname,input,cdir,N0,N1,true);
+        if(MP::host_id == 0) {
+            for(Int s = 1;s < S;s++) {
+                forEach(fields,i)
+                    copyFile(fieldPath(cdir,fields[i],ns[s]),
+                             fieldPath(dirs[s],fields[i],ns[s]));
+            }
+        }
+    }
+    MP::join();
+    MP::barrier();
+    
+    /*iterate*/
+    Int k = 0;
+    for(;;k++) {
+        /*fine solution*/
+        MP::split(group);
+        if(group >= k)
+            propagate(sname,input,dirs[group],ns[group],ns[group + 1],false);
+        MP::join();
+        MP::barrier();
+        if(k == S - 1 || k + 1 == Parareal::max_iterations)
+            break;
+        
+        /*sequential coarse correction*/
+        Scalar diff = 0;
+        MP::split(group);
+        if(group == 0) {
+            if(MP::host_id == 0)
+                diff = correct("",dirs[k],"",dirs[k + 1],ns[k + 1]);
+            for(Int s = k + 1;s < S - 1;s++) {
+                if(MP::host_id == 0) {
+                    forEach(fields,i) {
+                        copyFile(fieldPath(cdir,fields[i],ns[s + 1]),
+                                 fieldPath(odir,fields[i],ns[s + 1]));
+                        copyFile(fieldPath(dirs[s],fields[i],ns[s]),
+                                 fieldPath(cdir,fields[i],ns[s]));
+                    }
+                }
+                propagate(sname,input,cdir,ns[s],ns[s + 1],true);
+                if(MP::host_id == 0)
+                    diff = max(diff,correct(cdir,dirs[s],odir,dirs[s + 1],ns[s + 1]));
+            }
+        }
+        MP::join();
+        Scalar global_diff;
+        MP::allreduce(&diff,&global_diff,1,MP::OP_MAX);
+        if(world_id == 0)
+            MP::printH("Parareal iteration %d correction %.5e\n",k,global_diff);
+        if(global_diff <= Parareal::tolerance)
+            break;
+    }
+    
+    /*collect fine solution*/
+    if(world_id == 0) {
+        MP::printH("Parareal finished after %d iterations\n",k + 1);
+        for(Int s = 0;s < S;s++) {
+            for(Int n = ns[s] + 1;n <= ns[s + 1];n++) {
+                forEach(fields,i)
+                    copyFile(fieldPath(dirs[s],fields[i],n),
+                             fieldPath(".",fields[i],n));
+            }
+        }
+    }
+    MP::barrier();
+}
+/**
+ \verbatim
+ Ensemble driver
+ ~~~~~~~~~~~~~~~
+ Runs variants of a case, e.g. with different inflow conditions or model
+ constants, in one job. Each member has its own directory that holds its
+ initial fields and optionally a controls file, whose solver blocks are 
+ read after those of the main input and thus override them.
+ 
+ Members of the transport solver share their operator if they have no 
+ controls file and the same velocity field. They differ only in the 
+ initial and boundary values of T, and are solved together by all 
+ processes as the scalars of the species solver in directory ensemble. 
+ Up to three members then share the assembly and each matrix-vector 
+ product, and a decomposed run decomposes the mesh once for all of them.
+ The results are copied back to the member directories.
+ 
+ The remaining members are run in turn by groups of processes. Serial 
+ groups keep the mesh loaded, and share it with its geometry among their 
+ members. Decomposed groups give each member a copy of the mesh instead.
+ \endverbatim
+*/
+namespace Ensemble {
+    /** 
+    Copy the main input followed by a block, whose parameters then 
+    override those of the main input
+    */
+    void mergeInput(istream& input,istream& block,stringstream& merged) {
+        input.clear();
+        input.seekg(0,ios::beg);
+        merged << input.rdbuf() << endl;
+        input.clear();
+        input.seekg(0,ios::beg);
+        if(block.good())
+            merged << block.rdbuf();
+    }
+    /** Check if two files have the same contents */
+    bool sameFile(const string& a,const string& b) {
+        ifstream ia(a.c_str(),ios::binary),ib(b.c_str(),ios::binary);
+        if(ia.fail() || ib.fail())
+            return false;
+        stringstream sa,sb;
+        sa << ia.rdbuf();
+        sb << ib.rdbuf();
+        return (sa.str() == sb.str());
+    }
+    /**
+    Members of the transport solver without own controls whose 
+    velocity at write step n0 equals that of the first such member
+    */
+    void selectBatch(IntVector& batch,Int n0) {
+        batch.clear();
+        forEach(members,m) {
+            const string& dir = members[m];
+            ifstream is((dir + "/controls").c_str());
+            if(!is.fail())
+                continue;
+            if(batch.size() && 
+               !sameFile(fieldPath(members[batch[0]],"U",n0),fieldPath(dir,"U",n0)))
+                continue;
+            ifstream isT(fieldPath(dir,"T",n0).c_str());
+            if(!isT.fail())
+                batch.push_back(m);
+        }
+    }
+    /** Solve the members in batch together with the species solver */
+    void solveBatch(istream& input,const IntVector& batch,
+                    Scalar DT,Scalar t_UR,Int n0,Int n1) {
+        const string dir = "ensemble";
+        vector<string>& fields = BaseField::fieldNames;
+        vector<string> fields0 = fields;
+        
+        /*the T field of each member is a scalar of its own*/
+        vector<string> names(batch.size());
+        forEach(batch,k) {
+            stringstream name;
+            name << "T_" << k << "_";
+            names[k] = name.str();
+        }
+        if(MP::host_id == 0) {
+            MP::printH("Ensemble batch of %d members\n",int(batch.size()));
+            System::mkdir(dir);
+            copyMesh(dir,n0);
+            copyFile(fieldPath(members[batch[0]],"U",n0),fieldPath(dir,"U",n0));
+            forEach(batch,k)
+                copyFile(fieldPath(members[batch[k]],"T",n0),fieldPath(dir,names[k],n0));
+        }
+        MP::barrier();
+        
+        /*species parameters follow those of the main input*/
+        stringstream sblock, sinput;
+        sblock.precision(17);
+        sblock << "species\n{\n    scalars " << names.size() << " {";
+        forEach(names,k)
+            sblock << " " << names[k];
+        sblock << " }\n    DT " << DT << "\n    t_UR " << t_UR << "\n}\n";
+        mergeInput(input,sblock,sinput);
+        
+        /*solve*/
+        string sname = "species";
+        fields.assign(1,"U");
+        fields.insert(fields.end(),names.begin(),names.end());
+        solveInDir(sname,sinput,dir,n0,n1);
+        fields = fields0;
+        
+        /*hand the results back to the members*/
+        if(MP::host_id == 0) {
+            for(Int n = n0 + 1;n <= n1;n++) {
+                forEach(batch,k) {
+                    const string& mdir = members[batch[k]];
+                    if(copyFile(fieldPath(dir,names[k],n),fieldPath(mdir,"T",n)))
+                        copyFile(fieldPath(dir,"U",n),fieldPath(mdir,"U",n));
+                }
+            }
+        }
+        MP::barrier();
+    }
+}
+/**
+ Solve members of an ensemble
+ */
+void ensemble(string& sname,istream& input) {
+    using namespace Controls;
+    
+    vector<string>& members = Ensemble::members;
+    Int world_size = MP::n_hosts;
+    Int world_id = MP::host_id;
+    string base = MP::workingDir;
+    string meshName = Mesh::gMeshName;
+    Int amr_step0 = amr_step;
+    Int n0 = start_step / write_interval;
+    Int n1 = end_step / write_interval;
+    amr_step = 0;
+    
+    /*batch members of a passive scalar that share the operator*/
+    IntVector rest;
+    if(!Util::compare(sname,"transport")) {
+        TransportParams tp;
+        {
+            Util::ParamList params("transport");
+            tp.enroll(params);
+            input.clear();
+            input.seekg(0,ios::beg);
+            params.read(input);
+            input.clear();
+            input.seekg(0,ios::beg);
+        }
+        IntVector batch;
+        if(tp.active_threshold <= 0)
+            Ensemble::selectBatch(batch,n0);
+        if(batch.size() > 1)
+            Ensemble::solveBatch(input,batch,tp.DT,tp.t_UR,n0,n1);
+        else
+            batch.clear();
+        forEach(members,m) {
+            if(std::find(batch.begin(),batch.end(),m) == batch.end())
+                rest.push_back(m);
+        }
+    } else {
+        forEach(members,m)
+            rest.push_back(m);
+    }
+    
+    /*split processes into groups for the remaining members*/
+    if(rest.size()) {
+        Int G = min(Int(rest.size()),world_size);
+        Int group = world_id * G / world_size;
+        if(group > 0) {
+            stringstream log;
+            log << "ensemble" << group << ".log";
+            if(!freopen(log.str().c_str(),"w",stdout))
+                MP::printH("Failed to redirect output to %s\n",log.str().c_str());
+        }
+        MP::split(group);
+        bool shared = (MP::n_hosts == 1);
+        if(shared) {
+            Mesh::gMeshName = base + "/" + meshName;
+            Mesh::reuseMesh = true;
+        }
+        
+        /*run members*/
+        for(Int r = group;r < rest.size();r += G) {
+            const string& dir = members[rest[r]];
+            if(!shared) {
+                if(MP::host_id == 0)
+                    copyMesh(dir,n0);
+                MP::barrier();
+            }
+            MP::printH("Ensemble member %s\n",dir.c_str());
+            
+            /*member parameters follow those of the main input*/
+            stringstream minput;
+            {
+                string path = dir + "/controls";
+                ifstream is(path.c_str());
+                Ensemble::mergeInput(input,is,minput);
+            }
+            
+            /*solve*/
+            System::cd(dir);
+            System::pwd(MP::workingDir,PATH_MAX + 1);
+            runSolver(sname,minput);
+            System::cd(base);
+            System::pwd(MP::workingDir,PATH_MAX + 1);
+        }
+        
+        Mesh::gMeshName = meshName;
+        Mesh::reuseMesh = false;
+        MP::join();
+        MP::barrier();
+    }
+    
+    /*restore*/
+    amr_step = amr_step0;
+}
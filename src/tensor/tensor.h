@@ -729,6 +729,65 @@ public:
     }
 };
 
+/**
+Power with an exponent fixed over a whole expression. The exponent is
+classified once, and whole powers up to 15 as well as multiples of 1/2,
+1/3 or 1/6 with a numerator up to 15 are evaluated with cbrt, sqrt and
+multiplications instead of pow. The fast path is kept free of branches
+so that loops over fields are unswitched on the exponent class and still
+vectorized, which needs the flags to be ints rather than bools.
+*/
+class PowOp {
+    Scalar e;   /**< Exponent */
+    int root;   /**< Evaluate x^(m/root), or pow if root is 0 */
+    int m;      /**< Integer power of the root */
+    int inv;    /**< Negative exponent */
+public:
+    PowOp(Scalar b) : e(b), root(0), m(0), inv(b < 0) {
+        static const int roots[4] = {1, 2, 3, 6};
+        for(int j = 0;j < 4;j++) {
+            Scalar a = fabs(b) * roots[j];
+            if(a == floor(a) && a <= 15) {
+                root = roots[j];
+                m = int(a);
+                break;
+            }
+        }
+    }
+    Scalar operator()(Scalar x) const {
+        if(!root) 
+            return ::pow(x,e);
+        Scalar r = (root % 3) ? x : cbrt(x);
+        r = (root % 2) ? r : sqrt(r);
+        Scalar r2 = r * r, r4 = r2 * r2;
+        Scalar p = ((m & 1) ? r : 1) * ((m & 2) ? r2 : 1) * 
+                   ((m & 4) ? r4 : 1) * ((m & 8) ? r4 * r4 : 1);
+        return inv ? 1 / p : p;
+    }
+    template <Int SIZE>
+    TTensor<SIZE> operator()(const TTensor<SIZE>& x) const {
+        TTensor<SIZE> r;
+        for(Int j = 0;j < SIZE;j++)
+            r[j] = (*this)(x[j]);
+        return r;
+    }
+};
+
+/** Power of an expression with a fixed exponent */
+template<class C, class A>
+class DVPowExpr {
+protected:
+    A iter_;
+    PowOp op_;
+public:
+    DVPowExpr(const A& a, const Scalar& b)
+        : iter_(a), op_(b)
+    { }
+    C operator[](Int i) const { 
+        return op_(iter_[i]); 
+    }
+};
+
 template<class type, class C>
 class DVExpr {
 protected:
@@ -785,7 +844,16 @@ DEFINE_BINARY_SOP(ossub,-,operator -,type,Scalar);
 DEFINE_BINARY_SOP(osmul,*,operator *,type,Scalar);
 DEFINE_BINARY_SOP(osdiv,/,operator /,type,Scalar);
 
-DEFINE_BINARY_SOP2(opow,pow,type,Scalar);
+template<class type,class A>
+DVExpr<type,DVPowExpr<type,DVExpr<type,A> > >
+pow(const DVExpr<type,A>& a, const Scalar& b) {
+    typedef DVPowExpr<type,DVExpr<type,A> > ExprT;
+    return DVExpr<type,ExprT>(ExprT(a,b));
+}
+template<class type>
+DEFINE_BINARY_TSOP_PART1_B(opowInv,$,pow,type,Scalar,type)
+template<class type,class A>
+DEFINE_BINARY_TSOP_PART2_II(opowInv<type>,$,pow,type,Scalar)
 DEFINE_BINARY_SOP2(odev,dev,type,Scalar);
 DEFINE_BINARY_SOP2(ohyd,hyd,type,Scalar);
 DEFINE_BINARY_SOP2(omins,min,type,type);
@@ -22,7 +22,7 @@ void KE_Model::enroll() {
     params.enroll("C2e",&C2x);
 }
 void KE_Model::solve() {
-    ScalarCellMatrix M;
+    ScalarCellMatrix M,Mk;
     ScalarCellField eff_mu;
 
     /*turbulent dissipation*/
@@ -31,16 +31,26 @@ void KE_Model::solve() {
             (C1x * Pk * x / k),
             -(C2x * rho * x / k), &rho);
     FixNearWallValues(M);
-    Solve(M);
-    x = max(x,Constants::MachineEpsilon);
+    if(!coupled) {
+        Solve(M);
+        x = max(x,Constants::MachineEpsilon);
+    }
 
     /*turbulent kinetic energy*/
     eff_mu = eddy_mu / SigmaK + mu;
-    M = transport<Scalar>(k, U, F, eff_mu, k_UR,
+    Mk = transport<Scalar>(k, U, F, eff_mu, k_UR,
                 Pk,
                 -(rho * x / k), &rho);
     if(wallModel == STANDARD)
-        FixNearWallValues(M);
-    Solve(M);
-    k = max(k,Constants::MachineEpsilon);
+        FixNearWallValues(Mk);
+    if(coupled)
+        solveCoupled(Mk,M);
+    else {
+        Solve(Mk);
+        k = max(k,Constants::MachineEpsilon);
+    }
+}
+void KE_Model::crossJacobian(Int c,Scalar& dSk,Scalar& dSx) {
+    dSk = -rho[c];
+    dSx = (C2x * rho[c] * x[c] - C1x * Pk[c]) * x[c] / (k[c] * k[c]);
 }
@@ -10,6 +10,7 @@ struct KW_Model : public KX_Model {
     /*others*/
     virtual void enroll();
     virtual void solve();
+    virtual void crossJacobian(Int c,Scalar& dSk,Scalar& dSx);
     virtual void calcEddyMu() {
         eddy_mu = (rho * k) / x;
     };
@@ -1,20 +1,83 @@
 #include "les.h"
-/*
+/**
+\verbatim
 References:
     http://www.cfd-online.com/Wiki/Smagorinsky-Lilly_model
+    Kawai & Larsson, Wall-modeling in large eddy simulation (2012)
+Description:
+    Equilibrium wall-stress model. The tangential velocity Us is sampled at
+    a distance ys = sample_height * y1 from the wall, where y1 is the distance
+    of the wall cell centre. The law of the wall then gives the friction
+    velocity
+        Us / ustar = up(ys * ustar / nu)
+    and the wall shear is imposed through the eddy viscosity of the wall cell
+        (mu + eddy_mu) * U1 / y1 = rho * ustar^2
+    Sampling a few cells away from the wall avoids the log-layer mismatch of
+    under-resolved wall cells. A sample_height of 1 samples the wall cell.
+\endverbatim
 */
 LES_Model::LES_Model(VectorCellField& tU,ScalarFacetField& tF,ScalarCellField& trho,ScalarCellField& tmu) :
     MixingLength_Model(tU,tF,trho,tmu),
-    Cs(0.11)
+    Cs(0.11),
+    sample_height(1)
 {
 }
 void LES_Model::enroll() {
     params.enroll("Cs",&Cs);
+    params.enroll("sample_height",&sample_height);
     MixingLength_Model::enroll();
 }
 void LES_Model::calcLengthScale() {
     ScalarCellField delta = pow(Mesh::cV,Scalar(1./3));
     lm = Cs * delta;
 }
+/**
+Walk from cell c through face neighbours towards point p and
+return the internal cell whose centre is closest to it
+*/
+Int LES_Model::findSampleCell(Int c,const Vector& p) {
+    using namespace Mesh;
+    Scalar dmin = magSq(cC[c] - p);
+    while(true) {
+        Int cn = c;
+        forEach(gCells[c],j) {
+            Int fj = gCells[c][j];
+            Int nb = (gFOC[fj] == c) ? gFNC[fj] : gFOC[fj];
+            if(nb >= gBCS) continue;
+            Scalar d = magSq(cC[nb] - p);
+            if(d < dmin) {
+                dmin = d;
+                cn = nb;
+            }
+        }
+        if(cn == c) break;
+        c = cn;
+    }
+    return c;
+}
+void LES_Model::applyWallFunction(Int f,LawOfWall& low) {
+    using namespace Mesh;
+    Int c1 = FO[f];
+    Int c2 = FN[f];
+    Vector n = unit(fN[f]);
+    Scalar nu = mu[c1] / rho[c1];
+    Scalar y = mag(n & (cC[c1] - cC[c2]));
 
+    /*sample tangential velocity away from the wall*/
+    Int cs = c1;
+    if(sample_height > 1)
+        cs = findSampleCell(c1,fC[f] - n * (sample_height * y));
+    Scalar ys = mag(n & (cC[cs] - fC[f]));
+    Vector Us = U[cs] - n * (U[cs] & n);
 
+    /*calc ustar*/
+    Scalar ustar = low.getUstar(nu,mag(Us),ys);
+    if((ustar * ys) / nu < low.yLog)
+        ustar = sqrt(nu * mag(Us) / ys);
+
+    /*impose wall shear through the eddy viscosity*/
+    Vector U1 = U[c1] - n * (U[c1] & n);
+    Scalar tau = rho[c1] * ustar * ustar;
+    Scalar emu = tau * y / max(mag(U1),Constants::MachineEpsilon) - mu[c1];
+    eddy_mu[c1] = max(emu,Scalar(0));
+}
@@ -6,6 +6,7 @@
 struct LES_Model : public MixingLength_Model {
     /*model coefficients*/
     Scalar Cs;
+    Scalar sample_height;
 
     /*constructor*/
     LES_Model(VectorCellField&,ScalarFacetField&,ScalarCellField&,ScalarCellField&);
@@ -13,6 +14,8 @@ struct LES_Model : public MixingLength_Model {
     /*others*/
     virtual void enroll();
     virtual void calcLengthScale();
+    virtual void applyWallFunction(Int f,LawOfWall& low);
+    Int findSampleCell(Int c,const Vector& p);
 };
 
 #endif
@@ -44,7 +44,7 @@ void REALIZABLE_KE_Model::calcEddyViscosity(const TensorCellField& gradU) {
     KX_Model::calcEddyViscosity(gradU);
 }
 void REALIZABLE_KE_Model::solve() {
-    ScalarCellMatrix M;
+    ScalarCellMatrix M,Mk;
     ScalarCellField eff_mu;
 
     /*turbulent dissipation*/
@@ -53,16 +53,27 @@ void REALIZABLE_KE_Model::solve() {
                 (C1 * rho * magS * x),
                 -(C2x * rho * x / (k + sqrt(mu * x / rho))), &rho);
     FixNearWallValues(M);
-    Solve(M);
-    x = max(x,Constants::MachineEpsilon);
+    if(!coupled) {
+        Solve(M);
+        x = max(x,Constants::MachineEpsilon);
+    }
 
     /*turbulent kinetic energy*/
     eff_mu = eddy_mu / SigmaK + mu;
-    M = transport<Scalar>(k, U, F, eff_mu, k_UR,
+    Mk = transport<Scalar>(k, U, F, eff_mu, k_UR,
                     Pk,
                     -(rho * x / k), &rho);
     if(wallModel == STANDARD)
-        FixNearWallValues(M);
-    Solve(M);
-    k = max(k,Constants::MachineEpsilon);
+        FixNearWallValues(Mk);
+    if(coupled)
+        solveCoupled(Mk,M);
+    else {
+        Solve(Mk);
+        k = max(k,Constants::MachineEpsilon);
+    }
+}
+void REALIZABLE_KE_Model::crossJacobian(Int c,Scalar& dSk,Scalar& dSx) {
+    dSk = -rho[c];
+    Scalar d = k[c] + sqrt(mu[c] * x[c] / rho[c]);
+    dSx = C2x * rho[c] * x[c] * x[c] / (d * d);
 }
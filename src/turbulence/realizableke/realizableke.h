@@ -16,6 +16,7 @@ struct REALIZABLE_KE_Model : public KX_Model {
     /*others*/
     virtual void enroll();
     virtual void solve();
+    virtual void crossJacobian(Int c,Scalar& dSk,Scalar& dSx);
     virtual void calcEddyMu() {
         eddy_mu = (rho * CmuF * k * k) / x;
     };
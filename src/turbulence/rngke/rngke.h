@@ -15,6 +15,7 @@ struct RNG_KE_Model : public KE_Model {
 
     virtual void enroll();
     virtual void solve();
+    virtual void crossJacobian(Int c,Scalar& dSk,Scalar& dSx);
     virtual void calcEddyViscosity(const TensorCellField& gradU);
 };
 
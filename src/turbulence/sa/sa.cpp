@@ -0,0 +1,91 @@
+#include "sa.h"
+/**
+\verbatim
+References:
+    http://www.cfd-online.com/Wiki/Spalart-Allmaras_model
+Description:
+    One equation for the modified eddy viscosity nu without the trip term
+        D(rho*nu)/Dt = cb1*rho*St*nu - cw1*rho*fw*(nu/d)^2
+                     + (div((mu + rho*nu)*grad(nu)) + cb2*rho*|grad(nu)|^2) / sigma
+    with the eddy viscosity
+        eddy_mu = rho * nu * fv1,   fv1 = chi^3 / (chi^3 + cv1^3)
+    where chi = rho * nu / mu and d is the distance from the nearest wall.
+\endverbatim
+*/
+SA_Model::SA_Model(VectorCellField& tU,ScalarFacetField& tF,ScalarCellField& trho,ScalarCellField& tmu) :
+    EddyViscosity_Model(tU,tF,trho,tmu),
+    cb1(0.1355),
+    cb2(0.622),
+    sigma(2./3),
+    kappa(0.41),
+    cw2(0.3),
+    cw3(2),
+    cv1(7.1),
+    nu_UR(0.7),
+    nu("nu",READWRITE)
+{
+}
+void SA_Model::enroll() {
+    using namespace Util;
+    params.enroll("cb1",&cb1);
+    params.enroll("cb2",&cb2);
+    params.enroll("sigma",&sigma);
+    params.enroll("kappa",&kappa);
+    params.enroll("cw2",&cw2);
+    params.enroll("cw3",&cw3);
+    params.enroll("cv1",&cv1);
+    params.enroll("nu_UR",&nu_UR);
+    EddyViscosity_Model::enroll();
+}
+void SA_Model::calcEddyViscosity(const TensorCellField& gradU) {
+    TensorCellField O = skw(gradU);
+    magO = sqrt((O & O) * 2.0);
+    ScalarCellField chi3 = pow(rho * nu / mu,Scalar(3));
+    eddy_mu = rho * nu * chi3 / (chi3 + pow(cv1,Scalar(3)));
+}
+void SA_Model::solve() {
+    ScalarCellMatrix M;
+    ScalarCellField eff_mu;
+
+    /*modified vorticity*/
+    ScalarCellField d = max(Mesh::yWall,Constants::MachineEpsilon);
+    ScalarCellField kd2 = pow(kappa * d,Scalar(2));
+    ScalarCellField chi = rho * nu / mu;
+    ScalarCellField chi3 = pow(chi,Scalar(3));
+    ScalarCellField fv1 = chi3 / (chi3 + pow(cv1,Scalar(3)));
+    ScalarCellField fv2 = 1.0 - chi / (1.0 + chi * fv1);
+    ScalarCellField St = max(magO + nu * fv2 / kd2,magO * 0.3);
+
+    /*wall destruction*/
+    Scalar cw1 = cb1 / (kappa * kappa) + (1 + cb2) / sigma;
+    ScalarCellField r = min(nu / max(St * kd2,Constants::MachineEpsilon),10.0);
+    ScalarCellField g = r + cw2 * (pow(r,Scalar(6)) - r);
+    Scalar cw36 = pow(cw3,Scalar(6));
+    ScalarCellField fw = g * pow((1 + cw36) / (pow(g,Scalar(6)) + cw36),Scalar(1./6));
+
+    /*modified eddy viscosity*/
+    VectorCellField gnu = gradi(nu);
+    eff_mu = (mu + rho * nu) / sigma;
+    M = transport<Scalar>(nu, U, F, eff_mu, nu_UR,
+                    (cb1 * rho * St * nu + (cb2 / sigma) * rho * (gnu & gnu)),
+                    -(cw1 * rho * fw * nu / (d * d)), &rho);
+    FixNearWallValues(M);
+    Solve(M);
+    nu = max(nu,Constants::MachineEpsilon);
+}
+void SA_Model::applyWallFunction(Int f,LawOfWall& low) {
+    using namespace Mesh;
+    Int c1 = FO[f];
+    Int c2 = FN[f];
+
+    /*calc ustar*/
+    Scalar nuw = mu[c1] / rho[c1];
+    Scalar y = mag(unit(fN[f]) & (cC[c1] - cC[c2]));
+    Scalar ustar = low.getUstar(nuw,mag(U[c1]),y);
+    nu[c1] = kappa * ustar * y;
+
+    /* calculate eddy viscosity*/
+    Scalar yp = (ustar * y) / nuw;
+    Scalar up = low.getUp(ustar,nuw,yp);
+    eddy_mu[c1] = mu[c1] * (yp / up - 1);
+}
@@ -0,0 +1,31 @@
+#ifndef __SA_H
+#define __SA_H
+
+#include "turbulence.h"
+
+struct SA_Model : public EddyViscosity_Model {
+    /*model coefficients*/
+    Scalar cb1;
+    Scalar cb2;
+    Scalar sigma;
+    Scalar kappa;
+    Scalar cw2;
+    Scalar cw3;
+    Scalar cv1;
+    Scalar nu_UR;
+
+    /*turbulence fields*/
+    ScalarCellField nu;
+    ScalarCellField magO;
+
+    /*constructor*/
+    SA_Model(VectorCellField&,ScalarFacetField&,ScalarCellField&,ScalarCellField&);
+
+    /*others*/
+    virtual void enroll();
+    virtual void solve();
+    virtual void calcEddyViscosity(const TensorCellField& gradU);
+    virtual void applyWallFunction(Int f,LawOfWall& low);
+};
+
+#endif
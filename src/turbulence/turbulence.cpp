@@ -4,6 +4,7 @@
 #include "realizableke.h"
 #include "kw.h"
 #include "les.h"
+#include "sa.h"
 
 Int Turbulence_Model::turb_model = 2;
 bool Turbulence_Model::bneedWallDist = false;
@@ -11,8 +12,8 @@ bool Turbulence_Model::bneedWallDist = false;
 /** Register type of turbulence model desired */
 void Turbulence_Model::RegisterTable(Util::ParamList& params) {
     Util::Option* op;
-    op = new Util::Option(&turb_model,7,
-        "NONE","MIXING_LENGTH","KE","RNG_KE","REALIZABLE_KE","KW","LES");
+    op = new Util::Option(&turb_model,8,
+        "NONE","MIXING_LENGTH","KE","RNG_KE","REALIZABLE_KE","KW","LES","SA");
     params.enroll("turbulence_model",op);
 }
 
@@ -21,7 +22,7 @@ Turbulence_Model* Turbulence_Model::Select(VectorCellField& U,ScalarFacetField&
                     ScalarCellField& rho,ScalarCellField& mu) {
     /*turbulence model*/
     enum TurbModel {
-        NONE,MIXING_LENGTH,KE,RNG_KE,REALIZABLE_KE,KW,LES
+        NONE,MIXING_LENGTH,KE,RNG_KE,REALIZABLE_KE,KW,LES,SA
     };
     bneedWallDist = false;
     
@@ -48,6 +49,10 @@ Turbulence_Model* Turbulence_Model::Select(VectorCellField& U,ScalarFacetField&
             bneedWallDist = true;
             turb = new LES_Model(U,F,rho,mu); 
             break;
+        case SA:  
+            bneedWallDist = true;
+            turb = new SA_Model(U,F,rho,mu); 
+            break;
         default:
             turb = new Turbulence_Model(U,F,rho,mu); 
             break;
@@ -55,3 +60,109 @@ Turbulence_Model* Turbulence_Model::Select(VectorCellField& U,ScalarFacetField&
     turb->enroll();
     return turb;
 }
+
+/**
+Solve the model every update_step time steps with a time step enlarged
+accordingly. The eddy viscosity is computed on the step after an update
+and kept frozen until the next update. The stored history is spaced by
+the small step, so an enlarged update always uses BDF1. With a positive
+update_tolerance, the step adapts between 1 and update_interval. The
+eddy viscosity of the updated model is compared to that of the previous
+update. The step doubles while the relative change stays below half the
+tolerance, and it halves when the change exceeds the tolerance.
+*/
+void Turbulence_Model::update() {
+    if(++update_count < update_step)
+        return;
+    Int steps = update_count;
+    update_count = 0;
+    
+    /*advance over all the skipped steps at once*/
+    Scalar dt = Controls::dt;
+    Controls::TimeScheme scheme = Controls::time_scheme;
+    if(steps > 1) {
+        Controls::dt *= steps;
+        Controls::time_scheme = Controls::BDF1;
+    }
+    solve();
+    Controls::dt = dt;
+    Controls::time_scheme = scheme;
+    
+    /*adapt the step to the change of eddy viscosity*/
+    if(update_tolerance > 0) {
+        calcTurbVisc();
+        ScalarCellField emu = getTurbVisc();
+        Scalar s[2] = {0, 0}, gs[2];
+        for(Int i = 0;i < Mesh::gBCS;i++) {
+            Scalar d = emu[i] - update_emu[i];
+            s[0] += d * d;
+            s[1] += emu[i] * emu[i];
+        }
+        MP::allreduce(s,gs,2,MP::OP_SUM);
+        Scalar change = sqrt(sdiv(gs[0],gs[1]));
+        if(change > update_tolerance)
+            update_step = max(update_step / 2,Int(1));
+        else if(change < update_tolerance / 2)
+            update_step = min(update_step * 2,update_interval);
+        update_emu = emu;
+    } else
+        update_step = update_interval;
+}
+/**
+Solve the k and x equations together with a 2x2 block per cell. The
+cross derivatives of the source terms couple the blocks, so neither
+field is lagged in the other's destruction or generation term.
+*/
+void KX_Model::solveCoupled(ScalarCellMatrix& Mk,ScalarCellMatrix& Mx) {
+    using namespace Mesh;
+    
+    /*block solver has no DG element matrices*/
+    if(DG::NPMAT) {
+        Solve(Mx);
+        Solve(Mk);
+    } else {
+        BlockMatrix M(2);
+        ScalarCellMatrix* Ms[2] = {&Mk, &Mx};
+        applyImplicitBCs(Mk);
+        applyImplicitBCs(Mx);
+        M.cF[0] = &k;
+        M.cF[1] = &x;
+        for(Int j = 0;j < 2;j++) {
+            ScalarCellMatrix& m = *Ms[j];
+            for(Int c = 0;c < gBCS;c++) {
+                M.AP(c)[j * 3] = m.ap[c];
+                M.Su[j][c] = m.Su[c];
+            }
+            forEach(gFacets,f) {
+                M.AN(0,f)[j * 3] = m.an[0][f];
+                M.AN(1,f)[j * 3] = m.an[1][f];
+            }
+        }
+        
+        /*linearized source coupling, skipping cells with fixed values*/
+        for(Int c = 0;c < gBCS;c++) {
+            Scalar dSk, dSx;
+            crossJacobian(c,dSk,dSx);
+            Scalar* a = M.AP(c);
+            if(Mk.ap[c] < Scalar(10e30)) {
+                a[1] = dSk * cV[c];
+                M.Su[0][c] += a[1] * x[c];
+            }
+            if(Mx.ap[c] < Scalar(10e30)) {
+                a[2] = dSx * cV[c];
+                M.Su[1][c] += a[2] * k[c];
+            }
+        }
+        ScalarCellField k0 = k, x0 = x;
+        Solve(M);
+        /*the linearized coupling can overshoot, so limit the decrease*/
+        for(Int c = 0;c < gBCS;c++) {
+            k[c] = max(k[c],k0[c] / 10);
+            x[c] = max(x[c],x0[c] / 10);
+        }
+        applyExplicitBCs(k,true,false);
+        applyExplicitBCs(x,true,false);
+    }
+    x = max(x,Constants::MachineEpsilon);
+    k = max(k,Constants::MachineEpsilon);
+}
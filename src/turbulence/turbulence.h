@@ -65,6 +65,14 @@ struct Turbulence_Model {
 
     Util::ParamList params;
     bool writeStress;
+    
+    /*update frequency*/
+    Int update_interval;
+    Scalar update_tolerance;
+    Int update_step;
+    Int update_count;
+    FloatField<Scalar,CELL> update_emu;
+    
     /*constructor*/
     Turbulence_Model(VectorCellField& tU,ScalarFacetField& tF,ScalarCellField& trho,ScalarCellField& tmu) :
         U(tU),
@@ -72,7 +80,12 @@ struct Turbulence_Model {
         rho(trho),
         mu(tmu),
         params("turbulence"),
-        writeStress(false)
+        writeStress(false),
+        update_interval(1),
+        update_tolerance(0),
+        update_step(1),
+        update_count(0),
+        update_emu(Scalar(0))
     {
     }
     virtual ~Turbulence_Model() {};
@@ -81,12 +94,22 @@ struct Turbulence_Model {
         using namespace Util;
         Option* op = new BoolOption(&writeStress);
         params.enroll("writeStress",op);
+        params.enroll("update_interval",&update_interval);
+        params.enroll("update_tolerance",&update_tolerance);
     };
     virtual void solve() {};
+    void update();
+    /* eddy viscosity is kept from the step after the last update */
+    bool frozen() {
+        return update_count != 0;
+    }
     /* Turbulence viscosity */
     virtual ScalarCellField getTurbVisc() {
         return Scalar(0);
     }
+    /* Recompute turbulence viscosity from the model fields */
+    virtual void calcTurbVisc() {
+    }
     /* Explicit V */
     virtual VectorCellField getExplicitStresses() {
         return divi(mu * dev(trn(gradi(U)),2.0));
@@ -147,12 +170,19 @@ struct EddyViscosity_Model : public Turbulence_Model {
     virtual ScalarCellField getTurbVisc() {
         return eddy_mu;
     }
+    virtual void calcTurbVisc() {
+        calcEddyViscosity(gradi(U));
+        setWallEddyMu();
+        fillBCs(eddy_mu);
+    }
     /* Explicit V + R */
     virtual VectorCellField getExplicitStresses() {
         TensorCellField gradU = gradi(U);
-        calcEddyViscosity(gradU);
-        setWallEddyMu();
-        fillBCs(eddy_mu);
+        if(!frozen()) {
+            calcEddyViscosity(gradU);
+            setWallEddyMu();
+            fillBCs(eddy_mu);
+        }
         return divi((eddy_mu + mu) * dev(trn(gradU),2.0));
     };
 
@@ -230,6 +260,7 @@ struct KX_Model : public EddyViscosity_Model {
 
     Scalar k_UR;
     Scalar x_UR;
+    Int coupled;
 
     /*turbulence fields*/
     ScalarCellField k;         
@@ -241,6 +272,7 @@ struct KX_Model : public EddyViscosity_Model {
         EddyViscosity_Model(tU,tF,trho,tmu),
         k_UR(0.7),
         x_UR(0.7),
+        coupled(0),
         k("k",READWRITE),
         x(xname,READWRITE)
     {
@@ -253,11 +285,16 @@ struct KX_Model : public EddyViscosity_Model {
         using namespace Util;
         params.enroll("k_UR",&k_UR);
         params.enroll("x_UR",&x_UR);
+        Option* op = new BoolOption(&coupled);
+        params.enroll("coupled",op);
         EddyViscosity_Model::enroll();
     }
     /* k-x model specific over-ridables*/
     virtual void calcEddyMu() = 0;
     virtual Scalar calcX(Scalar ustar,Scalar kappa,Scalar y) = 0;
+    /* derivatives of the k and x sources with respect to x and k */
+    virtual void crossJacobian(Int c,Scalar& dSk,Scalar& dSx) = 0;
+    void solveCoupled(ScalarCellMatrix& Mk,ScalarCellMatrix& Mx);
     virtual Scalar getCmu(Int i) { 
         return Cmu; 
     }